@@ -0,0 +1,60 @@
+// e4b: Embedding database in C/C++
+// shared_ptr with atomic load, store and exchange.
+//
+// Uses std::atomic<std::shared_ptr<T>> where the library provides it
+// (__cpp_lib_atomic_shared_ptr, C++20) and the std::atomic_* free functions
+// otherwise; the latter are deprecated in C++20. Neither is lock-free in
+// libstdc++: the free functions take a mutex from a global pool keyed by the
+// pointer's address, and std::atomic<std::shared_ptr> spins on a lock bit in
+// its control block pointer. Either lock is held only for the pointer copy and
+// reference count update, never while a caller runs other code.
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace e4b {
+
+template <typename T>
+class atomic_shared_ptr {
+public:
+    atomic_shared_ptr() = default;
+
+    explicit atomic_shared_ptr(std::shared_ptr<T> p) : p_(std::move(p)) {}
+
+    atomic_shared_ptr(const atomic_shared_ptr &)             = delete;
+    atomic_shared_ptr & operator=(const atomic_shared_ptr &) = delete;
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+    std::shared_ptr<T> load(std::memory_order order = std::memory_order_seq_cst) const { return p_.load(order); }
+
+    void store(std::shared_ptr<T> p, std::memory_order order = std::memory_order_seq_cst) {
+        p_.store(std::move(p), order);
+    }
+
+    std::shared_ptr<T> exchange(std::shared_ptr<T> p, std::memory_order order = std::memory_order_seq_cst) {
+        return p_.exchange(std::move(p), order);
+    }
+
+private:
+    std::atomic<std::shared_ptr<T>> p_;
+#else
+    std::shared_ptr<T> load(std::memory_order order = std::memory_order_seq_cst) const {
+        return std::atomic_load_explicit(&p_, order);
+    }
+
+    void store(std::shared_ptr<T> p, std::memory_order order = std::memory_order_seq_cst) {
+        std::atomic_store_explicit(&p_, std::move(p), order);
+    }
+
+    std::shared_ptr<T> exchange(std::shared_ptr<T> p, std::memory_order order = std::memory_order_seq_cst) {
+        return std::atomic_exchange_explicit(&p_, std::move(p), order);
+    }
+
+private:
+    std::shared_ptr<T> p_;
+#endif
+};
+
+} // namespace e4b
@@ -0,0 +1,472 @@
+// e4b: Embedding database in C/C++
+// Column-wise payload storage for a segment, with projection pushdown.
+//
+// Each payload field is stored as its own column, so fetching a few fields
+// for the final top-k reads only those columns' pages:
+//   int64   frame of reference plus bit packing (bits of max - min per row)
+//   double  plain
+//   string  dictionary (bit-packed codes into sorted distinct values) when
+//           there are few distinct values, plain offsets + bytes otherwise
+//
+// payload_reader maps the file and parses only the column directory, checking
+// that every column body is large enough for its rows; rows are decoded on
+// demand, straight from the mapping, and a corrupt string offset or dictionary
+// code throws std::runtime_error when read. Returned string_views point
+// into the mapping and stay valid while the reader lives.
+//
+// File layout (little-endian):
+//   magic "E4BCOLS1", u64 rows, u32 columns, u32 0
+//   columns x { u16 name length, name, u8 type, u8 encoding, u64 offset, u64 bytes }
+//   column bodies, each starting at an 8-byte aligned offset
+#pragma once
+
+#include "mapped_file.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace e4b {
+
+enum class column_type : uint8_t { int64, float64, string };
+
+enum class column_encoding : uint8_t { bitpacked, plain, dictionary };
+
+using payload_value = std::variant<std::monostate, int64_t, double, std::string_view>;
+
+namespace detail {
+
+constexpr char columns_magic[8] = {'E', '4', 'B', 'C', 'O', 'L', 'S', '1'};
+
+inline unsigned bits_for(uint64_t max) {
+    unsigned b = 0;
+    while (b < 64 && (max >> b) != 0) {
+        ++b;
+    }
+    return b;
+}
+
+// Packs n values of `bits` bits; one spare word lets unpack read two words
+// unconditionally.
+inline std::vector<uint64_t> pack_bits(const uint64_t * v, size_t n, unsigned bits) {
+    std::vector<uint64_t> words((n * bits + 63) / 64 + 1, 0);
+    for (size_t i = 0; i < n && bits > 0; ++i) {
+        const size_t   at    = i * bits;
+        const unsigned shift = static_cast<unsigned>(at % 64);
+        words[at / 64] |= v[i] << shift;
+        if (shift + bits > 64) {
+            words[at / 64 + 1] |= v[i] >> (64 - shift);
+        }
+    }
+    return words;
+}
+
+inline uint64_t unpack_bits(const uint8_t * words, size_t i, unsigned bits) {
+    if (bits == 0) {
+        return 0;
+    }
+    const size_t   at    = i * bits;
+    const unsigned shift = static_cast<unsigned>(at % 64);
+    uint64_t       lo, hi;
+    std::memcpy(&lo, words + at / 64 * 8, 8);
+    std::memcpy(&hi, words + at / 64 * 8 + 8, 8);
+    uint64_t v = lo >> shift;
+    if (shift + bits > 64) {
+        v |= hi << (64 - shift);
+    }
+    return bits == 64 ? v : v & ((uint64_t{ 1 } << bits) - 1);
+}
+
+inline void put_bytes(std::vector<uint8_t> & out, const void * p, size_t n) {
+    out.insert(out.end(), static_cast<const uint8_t *>(p), static_cast<const uint8_t *>(p) + n);
+}
+
+template <typename T>
+void put(std::vector<uint8_t> & out, T v) {
+    put_bytes(out, &v, sizeof(v));
+}
+
+template <typename T>
+T get(const uint8_t * p) {
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+} // namespace detail
+
+// Collects whole columns of one segment and writes them out.
+class payload_builder {
+public:
+    explicit payload_builder(size_t rows) : rows_(rows) {}
+
+    // Strings with at most max_dictionary_ratio * rows distinct values are
+    // dictionary encoded; above that the dictionary saves too little to pay
+    // for its codes.
+    double max_dictionary_ratio = 0.5;
+
+    void add_int64(const std::string & name, const std::vector<int64_t> & v) {
+        check(name, v.size());
+        std::vector<uint8_t>  body;
+        const int64_t         base = v.empty() ? 0 : *std::min_element(v.begin(), v.end());
+        std::vector<uint64_t> delta(v.size());
+        uint64_t              max = 0;
+        for (size_t i = 0; i < v.size(); ++i) {
+            delta[i] = static_cast<uint64_t>(v[i]) - static_cast<uint64_t>(base);
+            max      = std::max(max, delta[i]);
+        }
+        const unsigned bits = detail::bits_for(max);
+        detail::put(body, base);
+        detail::put(body, static_cast<uint64_t>(bits));
+        const auto words = detail::pack_bits(delta.data(), delta.size(), bits);
+        detail::put_bytes(body, words.data(), words.size() * 8);
+        cols_.push_back({name, column_type::int64, column_encoding::bitpacked, std::move(body)});
+    }
+
+    void add_double(const std::string & name, const std::vector<double> & v) {
+        check(name, v.size());
+        std::vector<uint8_t> body;
+        detail::put_bytes(body, v.data(), v.size() * sizeof(double));
+        cols_.push_back({name, column_type::float64, column_encoding::plain, std::move(body)});
+    }
+
+    void add_string(const std::string & name, const std::vector<std::string> & v) {
+        check(name, v.size());
+        std::vector<std::string> dict(v);
+        std::sort(dict.begin(), dict.end());
+        dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+        std::vector<uint8_t> body;
+        if (static_cast<double>(dict.size()) <= max_dictionary_ratio * static_cast<double>(rows_)) {
+            std::vector<uint64_t> codes(v.size());
+            for (size_t i = 0; i < v.size(); ++i) {
+                codes[i] = static_cast<uint64_t>(std::lower_bound(dict.begin(), dict.end(), v[i]) - dict.begin());
+            }
+            const unsigned bits = detail::bits_for(dict.empty() ? 0 : dict.size() - 1);
+            detail::put(body, static_cast<uint64_t>(dict.size()));
+            detail::put(body, static_cast<uint64_t>(bits));
+            put_strings(body, dict);
+            const auto words = detail::pack_bits(codes.data(), codes.size(), bits);
+            detail::put_bytes(body, words.data(), words.size() * 8);
+            cols_.push_back({name, column_type::string, column_encoding::dictionary, std::move(body)});
+        } else {
+            put_strings(body, v);
+            cols_.push_back({name, column_type::string, column_encoding::plain, std::move(body)});
+        }
+    }
+
+    // Written to a temporary and renamed, so a crash never leaves a torn file.
+    void write(const std::string & path) const {
+        std::vector<uint8_t> head;
+        detail::put_bytes(head, detail::columns_magic, sizeof(detail::columns_magic));
+        detail::put(head, static_cast<uint64_t>(rows_));
+        detail::put(head, static_cast<uint32_t>(cols_.size()));
+        detail::put(head, uint32_t{ 0 });
+        size_t dir_bytes = head.size();
+        for (const column & c : cols_) {
+            dir_bytes += 2 + c.name.size() + 2 + 16;
+        }
+        uint64_t offset = (dir_bytes + 7) / 8 * 8;
+        for (const column & c : cols_) {
+            detail::put(head, static_cast<uint16_t>(c.name.size()));
+            detail::put_bytes(head, c.name.data(), c.name.size());
+            detail::put(head, static_cast<uint8_t>(c.type));
+            detail::put(head, static_cast<uint8_t>(c.encoding));
+            detail::put(head, offset);
+            detail::put(head, static_cast<uint64_t>(c.body.size()));
+            offset += (c.body.size() + 7) / 8 * 8;
+        }
+        head.resize((head.size() + 7) / 8 * 8);
+
+        const std::string tmp = path + ".tmp";
+        std::FILE *       f   = std::fopen(tmp.c_str(), "wb");
+        if (!f) {
+            throw std::system_error(errno, std::generic_category(), "columnar: open " + tmp);
+        }
+        const uint8_t pad[8] = {};
+        bool          ok     = std::fwrite(head.data(), head.size(), 1, f) == 1;
+        for (const column & c : cols_) {
+            ok = ok && (c.body.empty() || std::fwrite(c.body.data(), c.body.size(), 1, f) == 1);
+            ok = ok && (c.body.size() % 8 == 0 || std::fwrite(pad, 8 - c.body.size() % 8, 1, f) == 1);
+        }
+        if (!ok) {
+            const int err = errno;
+            std::fclose(f);
+            std::remove(tmp.c_str());
+            throw std::system_error(err, std::generic_category(), "columnar: write " + tmp);
+        }
+        if (std::fclose(f) != 0 || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            throw std::system_error(errno, std::generic_category(), "columnar: save " + path);
+        }
+    }
+
+private:
+    struct column {
+        std::string          name;
+        column_type          type;
+        column_encoding      encoding;
+        std::vector<uint8_t> body;
+    };
+
+    void check(const std::string & name, size_t n) const {
+        if (n != rows_) {
+            throw std::invalid_argument("columnar: column " + name + " has the wrong number of rows");
+        }
+        if (name.size() > UINT16_MAX) {
+            throw std::invalid_argument("columnar: column name too long");
+        }
+        for (const column & c : cols_) {
+            if (c.name == name) {
+                throw std::invalid_argument("columnar: duplicate column " + name);
+            }
+        }
+    }
+
+    // u64 offsets[n + 1] then the bytes, padded to 8.
+    static void put_strings(std::vector<uint8_t> & body, const std::vector<std::string> & s) {
+        uint64_t off = 0;
+        detail::put(body, off);
+        for (const std::string & x : s) {
+            off += x.size();
+            detail::put(body, off);
+        }
+        for (const std::string & x : s) {
+            detail::put_bytes(body, x.data(), x.size());
+        }
+        body.resize((body.size() + 7) / 8 * 8);
+    }
+
+    size_t              rows_;
+    std::vector<column> cols_;
+};
+
+class payload_reader {
+public:
+    static payload_reader open(const std::string & path) {
+        payload_reader r;
+        r.file_           = mapped_file::open(path);
+        const uint8_t * p = r.file_.data();
+        const size_t    n = r.file_.size();
+        if (n < 24 || std::memcmp(p, detail::columns_magic, sizeof(detail::columns_magic)) != 0) {
+            throw std::runtime_error("columnar: bad magic in " + path);
+        }
+        r.rows_            = static_cast<size_t>(detail::get<uint64_t>(p + 8));
+        const uint32_t nc  = detail::get<uint32_t>(p + 16);
+        size_t         pos = 24;
+        for (uint32_t c = 0; c < nc; ++c) {
+            if (pos + 2 > n) {
+                throw std::runtime_error("columnar: truncated directory in " + path);
+            }
+            const size_t len = detail::get<uint16_t>(p + pos);
+            if (pos + 2 + len + 18 > n) {
+                throw std::runtime_error("columnar: truncated directory in " + path);
+            }
+            column col;
+            col.name = std::string(reinterpret_cast<const char *>(p + pos + 2), len);
+            pos += 2 + len;
+            col.type             = static_cast<column_type>(p[pos]);
+            col.encoding         = static_cast<column_encoding>(p[pos + 1]);
+            const uint64_t off   = detail::get<uint64_t>(p + pos + 2);
+            const uint64_t bytes = detail::get<uint64_t>(p + pos + 10);
+            pos += 18;
+            if (off > n || bytes > n - off) {
+                throw std::runtime_error("columnar: column " + col.name + " out of bounds in " + path);
+            }
+            col.body = p + off;
+            if (!r.parse(col, static_cast<size_t>(bytes))) {
+                throw std::runtime_error("columnar: corrupt column " + col.name + " in " + path);
+            }
+            r.index_.emplace(col.name, r.cols_.size());
+            r.cols_.push_back(std::move(col));
+        }
+        // Top-k fetches touch scattered rows.
+        r.file_.advise(access_hint::random);
+        return r;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t column_count() const { return cols_.size(); }
+
+    const std::string & column_name(size_t c) const { return cols_[c].name; }
+    column_type         type(size_t c) const { return cols_[c].type; }
+    column_encoding     encoding(size_t c) const { return cols_[c].encoding; }
+
+    // Index of the column called `name`; throws std::out_of_range.
+    size_t column_index(const std::string & name) const {
+        auto it = index_.find(name);
+        if (it == index_.end()) {
+            throw std::out_of_range("columnar: no column " + name);
+        }
+        return it->second;
+    }
+
+    int64_t get_int64(size_t c, size_t row) const {
+        const uint8_t * b = body(c, column_type::int64, row);
+        // Unsigned addition wraps like the encoder's subtraction; a signed
+        // one would overflow on columns spanning more than INT64_MAX.
+        const uint64_t delta = detail::unpack_bits(cols_[c].words, row, cols_[c].bits);
+        return static_cast<int64_t>(static_cast<uint64_t>(detail::get<int64_t>(b)) + delta);
+    }
+
+    double get_double(size_t c, size_t row) const {
+        return detail::get<double>(body(c, column_type::float64, row) + row * sizeof(double));
+    }
+
+    std::string_view get_string(size_t c, size_t row) const {
+        const column & col = cols_[c];
+        body(c, column_type::string, row);
+        if (col.encoding == column_encoding::plain) {
+            return string_at(col, row);
+        }
+        const uint64_t code = detail::unpack_bits(col.words, row, col.bits);
+        if (code >= col.strings) {
+            throw std::runtime_error("columnar: corrupt dictionary code in column " + col.name);
+        }
+        return string_at(col, static_cast<size_t>(code));
+    }
+
+    payload_value get(size_t c, size_t row) const {
+        switch (cols_[c].type) {
+            case column_type::int64:   return get_int64(c, row);
+            case column_type::float64: return get_double(c, row);
+            case column_type::string:  return get_string(c, row);
+        }
+        return {};
+    }
+
+    // Projection pushdown: values of `columns` for each of `rows`, row-major
+    // (out[i * columns.size() + j]). Only the projected columns are read.
+    std::vector<payload_value> fetch(const idx_t * rows, size_t n, const std::vector<size_t> & columns) const {
+        std::vector<payload_value> out(n * columns.size());
+        // Column-at-a-time keeps each column's pages hot.
+        for (size_t j = 0; j < columns.size(); ++j) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i * columns.size() + j] = get(columns[j], static_cast<size_t>(rows[i]));
+            }
+        }
+        return out;
+    }
+
+    std::vector<payload_value> fetch(const idx_t * rows, size_t n, const std::vector<std::string> & names) const {
+        std::vector<size_t> columns;
+        columns.reserve(names.size());
+        for (const std::string & name : names) {
+            columns.push_back(column_index(name));
+        }
+        return fetch(rows, n, columns);
+    }
+
+private:
+    struct column {
+        std::string     name;
+        column_type     type;
+        column_encoding encoding;
+        const uint8_t * body = nullptr;
+        // Parsed by open(): bit-packed words, and the string offset table.
+        const uint8_t * words   = nullptr;
+        unsigned        bits    = 0;
+        const uint8_t * offsets = nullptr; // strings + 1 entries
+        size_t          strings = 0;
+        size_t          text    = 0;       // bytes after the offset table
+    };
+
+    payload_reader() = default;
+
+    // True when n packed values of `bits` bits, plus the spare word, fit in
+    // `avail` bytes.
+    static bool packed_fits(size_t avail, size_t n, uint64_t bits) {
+        if (bits > 64 || avail < 8) {
+            return false;
+        }
+        return bits == 0 || n <= (avail / 8 - 1) * 64 / bits;
+    }
+
+    // u64 offsets[count + 1] then the bytes; sets the table and returns its
+    // padded size, or 0 when it does not fit in `avail` bytes. Individual
+    // offsets are checked as they are read.
+    static size_t parse_strings(column & col, const uint8_t * b, size_t avail, size_t count) {
+        if (avail < 8 || count > avail / 8 - 1) {
+            return 0;
+        }
+        const size_t   table = 8 * (count + 1);
+        const uint64_t last  = detail::get<uint64_t>(b + 8 * count);
+        if (last > avail - table) {
+            return 0;
+        }
+        col.offsets = b;
+        col.strings = count;
+        col.text    = static_cast<size_t>(last);
+        return std::min(avail, (table + col.text + 7) / 8 * 8);
+    }
+
+    // Checks that the body of `bytes` bytes holds rows_ values of the
+    // column's type and encoding, so the getters never read past it.
+    bool parse(column & col, size_t bytes) const {
+        const uint8_t * b = col.body;
+        switch (col.type) {
+            case column_type::int64:
+                if (col.encoding != column_encoding::bitpacked || bytes < 16 ||
+                    !packed_fits(bytes - 16, rows_, detail::get<uint64_t>(b + 8))) {
+                    return false;
+                }
+                col.words = b + 16;
+                col.bits  = static_cast<unsigned>(detail::get<uint64_t>(b + 8));
+                return true;
+            case column_type::float64:
+                return col.encoding == column_encoding::plain && rows_ <= bytes / sizeof(double);
+            case column_type::string:
+                if (col.encoding == column_encoding::plain) {
+                    return parse_strings(col, b, bytes, rows_) != 0;
+                }
+                if (col.encoding == column_encoding::dictionary && bytes >= 16) {
+                    const uint64_t dict = detail::get<uint64_t>(b);
+                    const size_t   used = parse_strings(col, b + 16, bytes - 16, static_cast<size_t>(dict));
+                    if (used == 0 || !packed_fits(bytes - 16 - used, rows_, detail::get<uint64_t>(b + 8))) {
+                        return false;
+                    }
+                    col.words = b + 16 + used;
+                    col.bits  = static_cast<unsigned>(detail::get<uint64_t>(b + 8));
+                    return true;
+                }
+                return false;
+        }
+        return false;
+    }
+
+    const uint8_t * body(size_t c, column_type t, size_t row) const {
+        if (cols_[c].type != t) {
+            throw std::invalid_argument("columnar: column " + cols_[c].name + " has another type");
+        }
+        if (row >= rows_) {
+            throw std::out_of_range("columnar: row out of range");
+        }
+        return cols_[c].body;
+    }
+
+    static std::string_view string_at(const column & col, size_t i) {
+        const uint64_t begin = detail::get<uint64_t>(col.offsets + 8 * i);
+        const uint64_t end   = detail::get<uint64_t>(col.offsets + 8 * (i + 1));
+        if (begin > end || end > col.text) {
+            throw std::runtime_error("columnar: corrupt string offsets in column " + col.name);
+        }
+        const uint8_t * text = col.offsets + 8 * (col.strings + 1);
+        return std::string_view(reinterpret_cast<const char *>(text + begin), static_cast<size_t>(end - begin));
+    }
+
+    mapped_file                             file_;
+    size_t                                  rows_ = 0;
+    std::vector<column>                     cols_;
+    std::unordered_map<std::string, size_t> index_;
+};
+
+} // namespace e4b
@@ -0,0 +1,157 @@
+// e4b: Embedding database in C/C++
+// Read-only graph layouts for sealed segments.
+//
+// csr_graph stores each neighbor list sorted and delta-encoded with
+// StreamVByte, back to back, addressed by a per-node offset. Compared with
+// fixed-width 32-bit slots padded to the maximum degree this typically halves
+// graph memory, and decoding a list is a handful of pshufb per hop.
+//
+// fixed_graph keeps the padded layout. It is meant for the small, hot upper
+// layers of a hierarchical graph where a pointer into the slot array is
+// cheaper than any decode.
+//
+// Both expose the same read interface used by the graph search routines:
+//   size(), max_degree(), degree(v), neighbors(v, out) -> count, prefetch(v)
+// where `out` must hold max_degree() ids.
+#pragma once
+
+#include "streamvbyte.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace e4b {
+
+constexpr uint32_t invalid_node = std::numeric_limits<uint32_t>::max();
+
+using adjacency_list = std::vector<std::vector<uint32_t>>;
+
+class csr_graph {
+public:
+    csr_graph() = default;
+
+    // Neighbor order is not preserved: each list is sorted before encoding.
+    static csr_graph build(const adjacency_list & adj) {
+        csr_graph g;
+        g.offsets_.resize(adj.size() + 1);
+        g.degrees_.resize(adj.size());
+
+        size_t bound = 0;
+        for (const auto & l : adj) {
+            bound += svb_max_bytes(l.size());
+        }
+        g.data_.resize(bound + svb_padding);
+
+        std::vector<uint32_t> sorted;
+        size_t                pos = 0;
+        for (size_t v = 0; v < adj.size(); ++v) {
+            if (adj[v].size() > std::numeric_limits<uint16_t>::max()) {
+                throw std::invalid_argument("csr_graph: degree exceeds 65535");
+            }
+            sorted.assign(adj[v].begin(), adj[v].end());
+            std::sort(sorted.begin(), sorted.end());
+            g.offsets_[v]  = pos;
+            g.degrees_[v]  = static_cast<uint16_t>(sorted.size());
+            g.max_degree_  = std::max(g.max_degree_, sorted.size());
+            pos           += svb_encode_delta(sorted.data(), sorted.size(), g.data_.data() + pos);
+        }
+        g.offsets_[adj.size()] = pos;
+        g.data_.resize(pos + svb_padding);
+        g.data_.shrink_to_fit();
+        return g;
+    }
+
+    size_t size() const { return degrees_.size(); }
+    size_t max_degree() const { return max_degree_; }
+    size_t degree(uint32_t v) const { return degrees_[v]; }
+    size_t edge_count() const {
+        size_t n = 0;
+        for (uint16_t d : degrees_) {
+            n += d;
+        }
+        return n;
+    }
+
+    size_t neighbors(uint32_t v, uint32_t * out) const {
+        const size_t d = degrees_[v];
+        svb_decode_delta(data_.data() + offsets_[v], d, out);
+        return d;
+    }
+
+    void prefetch(uint32_t v) const {
+#if defined(__GNUC__)
+        __builtin_prefetch(data_.data() + offsets_[v]);
+#else
+        (void) v;
+#endif
+    }
+
+    size_t memory_bytes() const {
+        return offsets_.size() * sizeof(uint64_t) + degrees_.size() * sizeof(uint16_t) + data_.size();
+    }
+
+private:
+    std::vector<uint64_t> offsets_;
+    std::vector<uint16_t> degrees_;
+    std::vector<uint8_t>  data_;
+    size_t                max_degree_ = 0;
+};
+
+class fixed_graph {
+public:
+    fixed_graph() = default;
+
+    // Lists longer than max_degree are truncated; shorter ones are padded with invalid_node.
+    static fixed_graph build(const adjacency_list & adj, size_t max_degree) {
+        fixed_graph g;
+        g.n_          = adj.size();
+        g.max_degree_ = max_degree;
+        g.slots_.assign(adj.size() * max_degree, invalid_node);
+        for (size_t v = 0; v < adj.size(); ++v) {
+            std::copy_n(adj[v].begin(), std::min(adj[v].size(), max_degree), g.slots_.begin() + v * max_degree);
+        }
+        return g;
+    }
+
+    size_t size() const { return n_; }
+    size_t max_degree() const { return max_degree_; }
+
+    size_t degree(uint32_t v) const {
+        const uint32_t * p = list(v);
+        return static_cast<size_t>(std::find(p, p + max_degree_, invalid_node) - p);
+    }
+
+    // Fast path: the padded slot array of v, terminated by invalid_node or max_degree().
+    const uint32_t * list(uint32_t v) const { return slots_.data() + static_cast<size_t>(v) * max_degree_; }
+
+    size_t neighbors(uint32_t v, uint32_t * out) const {
+        const uint32_t * p = list(v);
+        size_t           d = 0;
+        while (d < max_degree_ && p[d] != invalid_node) {
+            out[d] = p[d];
+            ++d;
+        }
+        return d;
+    }
+
+    void prefetch(uint32_t v) const {
+#if defined(__GNUC__)
+        __builtin_prefetch(list(v));
+#else
+        (void) v;
+#endif
+    }
+
+    size_t memory_bytes() const { return slots_.size() * sizeof(uint32_t); }
+
+private:
+    size_t                n_          = 0;
+    size_t                max_degree_ = 0;
+    std::vector<uint32_t> slots_;
+};
+
+} // namespace e4b
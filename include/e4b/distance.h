@@ -0,0 +1,72 @@
+// e4b: Embedding database in C/C++
+// Distance kernels. Every index works with "smaller is better" distances:
+// squared L2, or negated inner product.
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+namespace e4b {
+
+enum class metric {
+    l2,            // squared euclidean distance
+    inner_product, // -<a, b>
+};
+
+// Four independent accumulators let the compiler vectorize without -ffast-math.
+inline float l2_sqr(const float * a, const float * b, size_t d) {
+    float  s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i  = 0;
+    for (; i + 4 <= d; i += 4) {
+        const float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1], d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < d; ++i) {
+        const float t = a[i] - b[i];
+        s0 += t * t;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+inline float inner_product(const float * a, const float * b, size_t d) {
+    float  s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i  = 0;
+    for (; i + 4 <= d; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < d; ++i) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+inline float distance(metric m, const float * a, const float * b, size_t d) {
+    return m == metric::l2 ? l2_sqr(a, b, d) : -inner_product(a, b, d);
+}
+
+// Distances from q to n consecutive rows of x, written to out.
+inline void distance_block(metric m, const float * q, const float * x, size_t n, size_t d, float * out) {
+    if (m == metric::l2) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = l2_sqr(q, x + i * d, d);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = -inner_product(q, x + i * d, d);
+        }
+    }
+}
+
+inline void check_dim(size_t d) {
+    if (d == 0) {
+        throw std::invalid_argument("e4b: dimension must be > 0");
+    }
+}
+
+} // namespace e4b
@@ -0,0 +1,536 @@
+// e4b: Embedding database in C/C++
+// In-memory proximity graph index built by incremental insertion.
+//
+// Each new vector is connected to the neighbors found by a beam search over
+// the graph built so far, pruned with the robust-prune (alpha-RNG) rule, and
+// back-linked from those neighbors; build() applies the same rule in bulk to
+// precomputed candidate lists (see nn_descent.h). Once built, seal() converts
+// the adjacency into the compressed csr_graph used by sealed segments.
+//
+// Re-pruning a full list on a back-link may drop the edge a node was reached
+// by, and in clustered data whole clusters then close off from the entry.
+// The index therefore keeps a spanning tree: every node records the parent
+// edge it was attached by, and no prune (insertion, back-link or relink)
+// drops it, so every node stays reachable from the entry. connect() repairs
+// reachability and derives the tree for graphs wrapped by assemble().
+//
+// search_filtered() walks the graph predicate-aware (filtered_beam_search);
+// graph_params::gamma builds the denser graph it works best on.
+#pragma once
+
+#include "csr_graph.h"
+#include "distance.h"
+#include "graph_search.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+struct graph_params {
+    metric m               = metric::l2;
+    size_t max_degree      = 32;
+    size_t ef_construction = 128;
+    float  alpha           = 1.2f; // > 1 keeps some longer edges, helping navigability
+
+    // Denser build for filtered search: > 1 tops the max_degree robust-pruned
+    // edges up with the nearest candidates to gamma * max_degree per node, so
+    // the subgraph induced by a selective filter stays connected.
+    size_t gamma = 1;
+};
+
+// Mutable graph used while building; implements the graph_search read interface.
+class adjacency_graph {
+public:
+    explicit adjacency_graph(size_t max_degree = 0) : max_degree_(max_degree) {}
+
+    size_t size() const { return adj_.size(); }
+    size_t max_degree() const { return max_degree_; }
+    size_t degree(uint32_t v) const { return adj_[v].size(); }
+
+    size_t neighbors(uint32_t v, uint32_t * out) const {
+        std::copy(adj_[v].begin(), adj_[v].end(), out);
+        return adj_[v].size();
+    }
+
+    void prefetch(uint32_t v) const {
+#if defined(__GNUC__)
+        __builtin_prefetch(adj_[v].data());
+#else
+        (void) v;
+#endif
+    }
+
+    std::vector<uint32_t> &       list(uint32_t v) { return adj_[v]; }
+    const std::vector<uint32_t> & list(uint32_t v) const { return adj_[v]; }
+    const adjacency_list &        lists() const { return adj_; }
+
+    uint32_t add_node() {
+        adj_.emplace_back();
+        return static_cast<uint32_t>(adj_.size() - 1);
+    }
+
+private:
+    adjacency_list adj_;
+    size_t         max_degree_;
+};
+
+class graph_index {
+public:
+    graph_index(size_t dim, graph_params p = {}) : dim_(dim), params_(p), graph_(p.max_degree * p.gamma) {
+        check_dim(dim);
+        if (p.max_degree == 0 || p.gamma == 0) {
+            throw std::invalid_argument("graph_index: max_degree and gamma must be > 0");
+        }
+    }
+
+    size_t                 size() const { return graph_.size(); }
+    size_t                 dim() const { return dim_; }
+    const graph_params &   params() const { return params_; }
+    const adjacency_graph & graph() const { return graph_; }
+    uint32_t               entry() const { return entry_; }
+    const float *          vector(uint32_t v) const { return data_.data() + static_cast<size_t>(v) * dim_; }
+
+    // Distance functor from q to any node, as consumed by beam_search.
+    auto dist_to(const float * q) const {
+        return [this, q](uint32_t v) { return distance(params_.m, q, vector(v), dim_); };
+    }
+
+    // Bulk build from precomputed candidate lists (e.g. a kNN graph):
+    // cands[v] holds candidates for node v with their distances. Each list,
+    // merged with its reverse edges, is robust-pruned and back-linked like an
+    // insertion. Lists this local (a kNN graph has no long edges) alone
+    // make a poor graph to search, so `passes` refinement rounds follow, as in
+    // Vamana: every node is searched for over the graph so far and re-linked
+    // from the hits plus its current neighbors. Nodes left unreachable from
+    // the entry are then linked to the closest reachable node a search finds.
+    // The entry is the node closest to the mean vector.
+    static graph_index build(const float * x, size_t n, size_t dim, const std::vector<std::vector<neighbor>> & cands,
+                             graph_params p = {}, size_t passes = 1) {
+        if (cands.size() != n) {
+            throw std::invalid_argument("graph_index: build needs one candidate list per vector");
+        }
+        graph_index g(dim, p);
+        if (n == 0) {
+            return g;
+        }
+        g.data_.assign(x, x + n * dim);
+        for (size_t v = 0; v < n; ++v) {
+            g.add_node();
+        }
+        std::vector<std::vector<neighbor>> merged(cands);
+        for (size_t v = 0; v < n; ++v) {
+            for (const neighbor & c : cands[v]) {
+                if (c.id >= 0 && static_cast<size_t>(c.id) < n) {
+                    merged[static_cast<size_t>(c.id)].push_back({c.dist, static_cast<idx_t>(v)});
+                }
+            }
+        }
+        for (size_t v = 0; v < n; ++v) {
+            g.graph_.list(static_cast<uint32_t>(v)) = g.prune(static_cast<uint32_t>(v), merged[v]);
+        }
+        merged.clear();
+        for (uint32_t v = 0; v < n; ++v) {
+            const std::vector<uint32_t> out = g.graph_.list(v);
+            for (uint32_t u : out) {
+                g.link(u, v);
+            }
+        }
+
+        std::vector<float> mean(dim, 0.0f);
+        for (size_t v = 0; v < n; ++v) {
+            for (size_t j = 0; j < dim; ++j) {
+                mean[j] += x[v * dim + j] / static_cast<float>(n);
+            }
+        }
+        g.entry_ = static_cast<uint32_t>(g.search(mean.data(), 1, p.ef_construction)[0].id);
+        // The tree connect() leaves keeps the refinement from cutting nodes off.
+        g.connect();
+        for (size_t pass = 0; pass < passes; ++pass) {
+            for (uint32_t v = 0; v < n; ++v) {
+                g.visited_.reset(n);
+                g.relink(v, beam_search(g.graph_, g.dist_to(g.vector(v)), &g.entry_, 1, p.ef_construction, g.visited_));
+            }
+        }
+        return g;
+    }
+
+    // Wraps existing vectors and adjacency, e.g. decoded from a sealed segment.
+    // The result has no spanning tree until connect() is called.
+    static graph_index assemble(const float * x, size_t n, size_t dim, adjacency_list adj, uint32_t entry,
+                                graph_params p = {}) {
+        if (adj.size() != n || (n != 0 && entry >= n)) {
+            throw std::invalid_argument("graph_index: assemble needs one list per vector and a valid entry");
+        }
+        graph_index g(dim, p);
+        g.data_.assign(x, x + n * dim);
+        for (size_t v = 0; v < n; ++v) {
+            if (adj[v].size() > g.graph_.max_degree()) {
+                throw std::invalid_argument("graph_index: assemble list exceeds max_degree");
+            }
+            g.graph_.list(g.add_node()) = std::move(adj[v]);
+        }
+        g.entry_ = entry;
+        return g;
+    }
+
+    // Re-prunes v's list from `cands` together with its current neighbors
+    // and back-links the result: a targeted refinement of one node.
+    void relink(uint32_t v, std::vector<neighbor> cands) {
+        for (uint32_t u : graph_.list(v)) {
+            cands.push_back({node_distance(v, u), static_cast<idx_t>(u)});
+        }
+        set_list(v, prune(v, cands));
+        for (uint32_t u : graph_.list(v)) {
+            link(u, v);
+        }
+    }
+
+    // Makes every node reachable from the entry: each unreached node v gets
+    // an edge from the closest reached node a search finds, one with a free
+    // slot if possible. If all are full, v takes over the nearest one's last
+    // edge and points on to the node it displaced (dropping one of its own
+    // edges if need be), so the repair never cuts off a reached node: only
+    // nodes that hung off the still unreached v can lose their path. Those
+    // are picked up by another round, flooded again from the entry; each
+    // round reaches more nodes, so the loop ends. A breadth-first tree of the
+    // result then becomes the spanning tree later edits preserve.
+    void connect() {
+        if (size() == 0) {
+            return;
+        }
+        std::vector<uint8_t>  reached;
+        std::vector<uint32_t> stack;
+        auto                  flood = [&](uint32_t from) {
+            reached[from] = 1;
+            stack.push_back(from);
+            while (!stack.empty()) {
+                const uint32_t u = stack.back();
+                stack.pop_back();
+                for (uint32_t w : graph_.list(u)) {
+                    if (!reached[w]) {
+                        reached[w] = 1;
+                        stack.push_back(w);
+                    }
+                }
+            }
+        };
+        for (bool repaired = true; repaired;) {
+            repaired = false;
+            reached.assign(size(), 0);
+            flood(entry_);
+            for (uint32_t v = 0; v < size(); ++v) {
+                if (reached[v]) {
+                    continue;
+                }
+                visited_.reset(size());
+                const std::vector<neighbor> found =
+                    beam_search(graph_, dist_to(vector(v)), &entry_, 1, params_.ef_construction, visited_);
+                uint32_t from = invalid_node;
+                for (const neighbor & c : found) {
+                    const uint32_t u = static_cast<uint32_t>(c.id);
+                    if (reached[u] && graph_.list(u).size() < graph_.max_degree()) {
+                        from = u;
+                        break;
+                    }
+                }
+                std::vector<uint32_t> & out = graph_.list(v);
+                if (from == invalid_node) {
+                    from                     = static_cast<uint32_t>(found.front().id);
+                    const uint32_t dropped   = graph_.list(from).back();
+                    graph_.list(from).back() = v;
+                    if (std::find(out.begin(), out.end(), dropped) == out.end()) {
+                        if (out.size() < graph_.max_degree()) {
+                            out.push_back(dropped);
+                        } else {
+                            out.back() = dropped;
+                        }
+                    }
+                } else {
+                    graph_.list(from).push_back(v);
+                }
+                if (out.size() < graph_.max_degree() && std::find(out.begin(), out.end(), from) == out.end()) {
+                    out.push_back(from);
+                }
+                flood(v);
+                repaired = true;
+            }
+        }
+        parent_.assign(size(), invalid_node);
+        children_.assign(size(), 0);
+        reached.assign(size(), 0);
+        reached[entry_] = 1;
+        stack.assign(1, entry_);
+        for (size_t i = 0; i < stack.size(); ++i) {
+            const uint32_t u = stack[i];
+            for (uint32_t w : graph_.list(u)) {
+                if (!reached[w]) {
+                    reached[w] = 1;
+                    parent_[w] = u;
+                    ++children_[u];
+                    stack.push_back(w);
+                }
+            }
+        }
+    }
+
+    void add(const float * x, size_t n) {
+        data_.reserve(data_.size() + n * dim_);
+        for (size_t i = 0; i < n; ++i) {
+            insert(x + i * dim_);
+        }
+    }
+
+    // With stop.patience set, the search may end before the beam converges;
+    // stop.k defaults to k.
+    std::vector<neighbor> search(const float * q, size_t k, size_t ef, search_stats * stats = nullptr,
+                                 termination stop = {}) const {
+        if (size() == 0) {
+            return {};
+        }
+        if (stop.k == 0) {
+            stop.k = k;
+        }
+        visited_list & visited = thread_visited(size());
+        auto           res     = beam_search(graph_, dist_to(q), &entry_, 1, std::max(ef, k), visited, stats, stop);
+        if (res.size() > k) {
+            res.resize(k);
+        }
+        return res;
+    }
+
+    // Returns the k nearest nodes passing `pass(v)`; see filtered_beam_search.
+    template <typename Pred>
+    std::vector<neighbor> search_filtered(const float * q, size_t k, size_t ef, Pred && pass,
+                                          search_stats * stats = nullptr) const {
+        if (size() == 0) {
+            return {};
+        }
+        visited_list & visited = thread_visited(size());
+        auto res = filtered_beam_search(graph_, dist_to(q), pass, &entry_, 1, std::max(ef, k), visited, stats);
+        if (res.size() > k) {
+            res.resize(k);
+        }
+        return res;
+    }
+
+    // Trains the patience rule on sample queries: returns the smallest
+    // patience whose mean recall@k against the exact k nearest neighbors
+    // reaches recall_target (doubling, then bisecting). The truth is brute
+    // force over the index, so the sample should be a few hundred queries:
+    // enough to hold the target on unseen ones, cheap enough to scan for. If
+    // the search without early termination misses the target too,
+    // termination is disabled. max_hops is passed through as the bound on the
+    // slowest queries.
+    termination calibrate_patience(const float * queries, size_t nq, size_t k, size_t ef, float recall_target,
+                                   size_t max_hops = 0) const {
+        if (nq == 0 || k == 0 || recall_target <= 0 || recall_target > 1) {
+            throw std::invalid_argument("graph_index: calibrate_patience needs queries, k > 0 and recall_target in (0, 1]");
+        }
+        std::vector<std::vector<neighbor>> truth(nq);
+        for (size_t i = 0; i < nq; ++i) {
+            const auto            dist = dist_to(queries + i * dim_);
+            std::vector<neighbor> all(size());
+            for (uint32_t v = 0; v < size(); ++v) {
+                all[v] = {dist(v), static_cast<idx_t>(v)};
+            }
+            const size_t kk = std::min(k, all.size());
+            std::partial_sort(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(kk), all.end());
+            all.resize(kk);
+            truth[i] = std::move(all);
+        }
+        auto reaches = [&](size_t patience) {
+            const termination stop{k, patience, max_hops};
+            size_t            hits = 0, total = 0;
+            for (size_t i = 0; i < nq; ++i) {
+                const auto res = search(queries + i * dim_, k, ef, nullptr, stop);
+                for (const neighbor & t : truth[i]) {
+                    hits += std::any_of(res.begin(), res.end(), [&](const neighbor & r) { return r.id == t.id; });
+                }
+                total += truth[i].size();
+            }
+            return static_cast<float>(hits) >= recall_target * static_cast<float>(total);
+        };
+        // Patience is at most ef: a hop that changes nothing in the top k
+        // for ef hops in a row has exhausted every candidate it could add.
+        const size_t limit = std::max(ef, k);
+        size_t       lo = 0, hi = 1; // lo fails (0: none tried), hi is next to try
+        while (hi < limit && !reaches(hi)) {
+            lo = hi;
+            hi *= 2;
+        }
+        hi = std::min(hi, limit); // reaches(hi), or hi == limit: no early stop
+        while (hi - lo > 1) {
+            const size_t mid = lo + (hi - lo) / 2;
+            (reaches(mid) ? hi : lo) = mid;
+        }
+        return {k, hi >= limit ? 0 : hi, max_hops};
+    }
+
+    csr_graph seal() const { return csr_graph::build(graph_.lists()); }
+
+    size_t memory_bytes() const {
+        size_t bytes = data_.size() * sizeof(float) + (parent_.size() + children_.size()) * sizeof(uint32_t);
+        for (const auto & l : graph_.lists()) {
+            bytes += l.capacity() * sizeof(uint32_t) + sizeof(l);
+        }
+        return bytes;
+    }
+
+private:
+    uint32_t add_node() {
+        parent_.push_back(invalid_node);
+        children_.push_back(0);
+        return graph_.add_node();
+    }
+
+    void insert(const float * x) {
+        const uint32_t v = add_node();
+        data_.insert(data_.end(), x, x + dim_);
+        if (v == 0) {
+            return;
+        }
+        visited_.reset(size());
+        std::vector<neighbor> cands = beam_search(graph_, dist_to(vector(v)), &entry_, 1, params_.ef_construction, visited_);
+        graph_.list(v)              = prune(v, cands);
+        attach(v);
+        for (uint32_t u : graph_.list(v)) {
+            link(u, v);
+        }
+    }
+
+    // Makes one of v's neighbors its tree parent: the nearest with room for
+    // another child. If every one is full of children, the nearest hands its
+    // last child over to v, which then points to it.
+    void attach(uint32_t v) {
+        std::vector<uint32_t> & out = graph_.list(v);
+        uint32_t                from = out.front();
+        for (uint32_t u : out) {
+            if (children_[u] < graph_.max_degree()) {
+                from = u;
+                break;
+            }
+        }
+        if (children_[from] >= graph_.max_degree()) {
+            const std::vector<uint32_t> & l = graph_.list(from);
+            const uint32_t c = *std::find_if(l.rbegin(), l.rend(), [&](uint32_t w) { return parent_[w] == from; });
+            if (std::find(out.begin(), out.end(), c) == out.end()) {
+                if (out.size() < graph_.max_degree()) {
+                    out.push_back(c);
+                } else {
+                    out.back() = c;
+                }
+            }
+            parent_[c] = v;
+            --children_[from];
+            ++children_[v];
+        }
+        parent_[v] = from;
+        ++children_[from];
+    }
+
+    // Adds the edge u -> v, re-pruning u's list when it overflows.
+    void link(uint32_t u, uint32_t v) {
+        std::vector<uint32_t> & back = graph_.list(u);
+        if (u == v || std::find(back.begin(), back.end(), v) != back.end()) {
+            return;
+        }
+        back.push_back(v);
+        if (back.size() > graph_.max_degree()) {
+            std::vector<neighbor> c;
+            c.reserve(back.size());
+            for (uint32_t w : back) {
+                c.push_back({node_distance(u, w), static_cast<idx_t>(w)});
+            }
+            set_list(u, prune(u, c));
+        }
+    }
+
+    // Installs `next` as u's list, keeping the edges to u's tree children:
+    // each displaces the last entry that is not one. There is always such an
+    // entry, as a node has at most max_degree children.
+    void set_list(uint32_t u, std::vector<uint32_t> next) {
+        if (children_[u] != 0) {
+            for (uint32_t w : graph_.list(u)) {
+                if (parent_[w] != u || std::find(next.begin(), next.end(), w) != next.end()) {
+                    continue;
+                }
+                if (next.size() < graph_.max_degree()) {
+                    next.push_back(w);
+                } else {
+                    *std::find_if(next.rbegin(), next.rend(), [&](uint32_t x) { return parent_[x] != u; }) = w;
+                }
+            }
+        }
+        graph_.list(u) = std::move(next);
+    }
+
+    float node_distance(uint32_t a, uint32_t b) const { return distance(params_.m, vector(a), vector(b), dim_); }
+
+    // Robust prune: keep a candidate only if no already kept neighbor is
+    // (alpha times) closer to it than v is. With gamma > 1 the max_degree
+    // pruned edges are kept first, so long-range routing survives, and the
+    // list is then filled up to gamma * max_degree with the nearest of the
+    // remaining candidates.
+    std::vector<uint32_t> prune(uint32_t v, std::vector<neighbor> & cands) const {
+        std::sort(cands.begin(), cands.end());
+        // alpha scales euclidean distances, hence alpha^2 on squared L2.
+        const float           a = params_.m == metric::l2 ? params_.alpha * params_.alpha : 1.0f;
+        std::vector<uint32_t> kept;
+        for (const neighbor & c : cands) {
+            const uint32_t u = static_cast<uint32_t>(c.id);
+            if (u == v || std::find(kept.begin(), kept.end(), u) != kept.end()) {
+                continue;
+            }
+            bool dominated = false;
+            for (uint32_t p : kept) {
+                if (a * node_distance(p, u) <= c.dist) {
+                    dominated = true;
+                    break;
+                }
+            }
+            if (!dominated) {
+                kept.push_back(u);
+                if (kept.size() >= params_.max_degree) {
+                    break;
+                }
+            }
+        }
+        if (params_.gamma > 1) {
+            fill_nearest(v, cands, kept);
+        }
+        return kept;
+    }
+
+    // The gamma > 1 fill: the closest candidates not kept yet, up to
+    // gamma * max_degree in total.
+    void fill_nearest(uint32_t v, const std::vector<neighbor> & sorted, std::vector<uint32_t> & kept) const {
+        for (const neighbor & c : sorted) {
+            if (kept.size() >= graph_.max_degree()) {
+                break;
+            }
+            const uint32_t u = static_cast<uint32_t>(c.id);
+            if (u != v && std::find(kept.begin(), kept.end(), u) == kept.end()) {
+                kept.push_back(u);
+            }
+        }
+    }
+
+    size_t             dim_;
+    graph_params       params_;
+    adjacency_graph    graph_;
+    std::vector<float> data_;
+    uint32_t           entry_ = 0;
+    visited_list       visited_;
+    // Spanning tree from the entry (invalid_node: no parent); every edge
+    // parent_[v] -> v is in the parent's list.
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> children_;
+};
+
+} // namespace e4b
@@ -0,0 +1,143 @@
+// e4b: Embedding database in C/C++
+// Merging two graph-indexed segments without a rebuild.
+//
+// The merged graph starts from the edges of both inputs (ids of the second
+// are offset by the size of the first) and only refines the smaller side:
+// each of its nodes is searched for in the larger graph, and the hits,
+// together with its existing neighbors, are robust-pruned into its new list
+// and back-linked. Both prunes may drop input edges: the smaller side's
+// lists are replaced, and a larger-side node that receives a back-link is
+// re-pruned when its list is full. Nodes cut off that way are linked back in
+// by graph_index::connect() afterwards, which also lets later add()s keep
+// the merged graph connected. Distance work is therefore one beam search per
+// node of the smaller segment plus one per node left unreachable; the rest
+// of the larger segment is only copied. Entry is the larger segment's entry.
+//
+// Inputs may be any graph with the graph_search read interface, so sealed
+// csr_graph segments merge directly; the result is a mutable graph_index to
+// seal() again.
+#pragma once
+
+#include "csr_graph.h"
+#include "distance.h"
+#include "graph_index.h"
+#include "graph_search.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+// One side of a merge: vectors (node v at x + v * dim), graph and entry.
+template <typename Graph>
+struct merge_input {
+    const float * x;
+    const Graph & graph;
+    uint32_t      entry;
+};
+
+struct merge_stats {
+    size_t refined   = 0; // nodes of the smaller segment re-linked
+    size_t hops      = 0;
+    size_t distances = 0;
+};
+
+namespace detail {
+
+template <typename Graph>
+void append_lists(const Graph & g, uint32_t offset, adjacency_list & adj) {
+    std::vector<uint32_t> nbrs(g.max_degree());
+    for (uint32_t v = 0; v < g.size(); ++v) {
+        const size_t          deg = g.neighbors(v, nbrs.data());
+        std::vector<uint32_t> l(nbrs.begin(), nbrs.begin() + static_cast<std::ptrdiff_t>(deg));
+        for (uint32_t & u : l) {
+            u += offset;
+        }
+        adj.push_back(std::move(l));
+    }
+}
+
+// Refines every node of `small` (global ids small_offset + v) against the
+// graph of `large` (global ids large_offset + v).
+template <typename Small, typename Large>
+void refine_side(graph_index & out, const merge_input<Small> & small, uint32_t small_offset,
+                 const merge_input<Large> & large, uint32_t large_offset, size_t ef, merge_stats & stats) {
+    const size_t dim = out.dim();
+    const metric m   = out.params().m;
+    search_stats local;
+    for (uint32_t v = 0; v < small.graph.size(); ++v) {
+        const float *  q       = small.x + static_cast<size_t>(v) * dim;
+        auto           dist    = [&](uint32_t u) { return distance(m, q, large.x + static_cast<size_t>(u) * dim, dim); };
+        visited_list & visited = thread_visited(large.graph.size());
+        std::vector<neighbor> cands = beam_search(large.graph, dist, &large.entry, 1, ef, visited, &local);
+        for (neighbor & c : cands) {
+            c.id += large_offset;
+        }
+        out.relink(small_offset + v, std::move(cands));
+    }
+    stats.refined += small.graph.size();
+    stats.hops += local.hops;
+    stats.distances += local.distances;
+}
+
+} // namespace detail
+
+// Merges a and b (same dim) into one graph_index over p: nodes [0, |a|) are
+// a's, [|a|, |a| + |b|) are b's. ef is the search width used to find each
+// refined node's neighbors in the other graph.
+template <typename GraphA, typename GraphB>
+graph_index merge_graphs(const merge_input<GraphA> & a, const merge_input<GraphB> & b, size_t dim, graph_params p,
+                         size_t ef, merge_stats * stats = nullptr) {
+    const size_t na = a.graph.size(), nb = b.graph.size();
+    if (na + nb >= invalid_node) {
+        throw std::invalid_argument("graph_merge: merged graph exceeds 2^32 - 1 nodes");
+    }
+    std::vector<float> x;
+    x.reserve((na + nb) * dim);
+    x.insert(x.end(), a.x, a.x + na * dim);
+    x.insert(x.end(), b.x, b.x + nb * dim);
+    adjacency_list adj;
+    adj.reserve(na + nb);
+    detail::append_lists(a.graph, 0, adj);
+    detail::append_lists(b.graph, static_cast<uint32_t>(na), adj);
+
+    const bool     a_large = na >= nb;
+    const uint32_t entry   = na + nb == 0 ? 0 : a_large ? a.entry : static_cast<uint32_t>(na) + b.entry;
+    graph_index    out     = graph_index::assemble(x.data(), na + nb, dim, std::move(adj), entry, p);
+    x.clear();
+    x.shrink_to_fit();
+
+    merge_stats local;
+    if (na != 0 && nb != 0) {
+        if (a_large) {
+            detail::refine_side(out, b, static_cast<uint32_t>(na), a, 0, ef, local);
+        } else {
+            detail::refine_side(out, a, 0, b, static_cast<uint32_t>(na), ef, local);
+        }
+    }
+    out.connect();
+    if (stats) {
+        stats->refined += local.refined;
+        stats->hops += local.hops;
+        stats->distances += local.distances;
+    }
+    return out;
+}
+
+// Merges two graph indexes built with the same parameters; b's nodes follow
+// a's.
+inline graph_index merge_graphs(const graph_index & a, const graph_index & b, size_t ef = 0,
+                                merge_stats * stats = nullptr) {
+    if (a.dim() != b.dim() || a.params().m != b.params().m) {
+        throw std::invalid_argument("graph_merge: indexes differ in dimension or metric");
+    }
+    const merge_input<adjacency_graph> ia{a.size() ? a.vector(0) : nullptr, a.graph(), a.entry()};
+    const merge_input<adjacency_graph> ib{b.size() ? b.vector(0) : nullptr, b.graph(), b.entry()};
+    return merge_graphs(ia, ib, a.dim(), a.params(), ef ? ef : a.params().ef_construction, stats);
+}
+
+} // namespace e4b
@@ -0,0 +1,270 @@
+// e4b: Embedding database in C/C++
+// Best-first beam search over a proximity graph.
+//
+// The search is generic over the graph layout: anything exposing
+//   size(), max_degree(), neighbors(v, out) -> count, prefetch(v)
+// works (adjacency_graph while building, csr_graph / fixed_graph once sealed),
+// and over the distance: `dist(v)` returns the distance from the query to
+// node v.
+#pragma once
+
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace e4b {
+
+// Epoch-stamped visited marks, reusable across searches without clearing.
+class visited_list {
+public:
+    void reset(size_t n) {
+        if (marks_.size() < n) {
+            marks_.assign(n, 0);
+            epoch_ = 0;
+        }
+        if (++epoch_ == 0) {
+            std::fill(marks_.begin(), marks_.end(), 0);
+            epoch_ = 1;
+        }
+    }
+
+    // Marks v; returns false if it was already marked in this epoch.
+    bool visit(uint32_t v) {
+        if (marks_[v] == epoch_) {
+            return false;
+        }
+        marks_[v] = epoch_;
+        return true;
+    }
+
+    bool visited(uint32_t v) const { return marks_[v] == epoch_; }
+
+private:
+    std::vector<uint16_t> marks_;
+    uint16_t              epoch_ = 0;
+};
+
+// Per-thread list for query paths; callers must not nest two searches on it.
+inline visited_list & thread_visited(size_t n) {
+    thread_local visited_list v;
+    v.reset(n);
+    return v;
+}
+
+struct search_stats {
+    size_t hops        = 0; // nodes expanded
+    size_t distances   = 0; // distance evaluations
+    size_t early_stops = 0; // searches ended by a termination rule
+};
+
+// Early termination for easy queries. The search tracks the k closest nodes
+// seen so far and stops once `patience` consecutive hops have left them
+// unchanged, or after max_hops expansions; 0 disables either rule.
+// graph_index::calibrate_patience() picks a patience for a recall target.
+struct termination {
+    size_t k        = 0;
+    size_t patience = 0;
+    size_t max_hops = 0;
+};
+
+// Returns up to ef nodes sorted by ascending distance. `visited` must have
+// been reset for g.size() nodes.
+template <typename Graph, typename DistFn>
+std::vector<neighbor> beam_search(const Graph & g, DistFn && dist, const uint32_t * entries, size_t n_entries,
+                                  size_t ef, visited_list & visited, search_stats * stats = nullptr,
+                                  const termination & stop = {}) {
+    using cand = std::pair<float, uint32_t>;
+    std::priority_queue<cand, std::vector<cand>, std::greater<cand>> frontier; // closest first
+    std::priority_queue<cand>                                        best;     // farthest first
+
+    // Distances of the k closest nodes so far (farthest on top), only kept
+    // when the patience rule is on.
+    const size_t                k = stop.patience > 0 ? std::max<size_t>(stop.k, 1) : 0;
+    std::priority_queue<float> top_k;
+    auto                       improves = [&](float d) {
+        if (top_k.size() < k) {
+            top_k.push(d);
+            return true;
+        }
+        if (k > 0 && d < top_k.top()) {
+            top_k.pop();
+            top_k.push(d);
+            return true;
+        }
+        return false;
+    };
+
+    ef = std::max<size_t>(ef, 1);
+    search_stats local;
+    for (size_t i = 0; i < n_entries; ++i) {
+        if (entries[i] < g.size() && visited.visit(entries[i])) {
+            const float d = dist(entries[i]);
+            ++local.distances;
+            frontier.emplace(d, entries[i]);
+            best.emplace(d, entries[i]);
+            improves(d);
+            if (best.size() > ef) {
+                best.pop();
+            }
+        }
+    }
+
+    std::vector<uint32_t> nbrs(g.max_degree());
+    size_t                stale = 0;
+    while (!frontier.empty()) {
+        const cand c = frontier.top();
+        if (best.size() >= ef && c.first > best.top().first) {
+            break;
+        }
+        if ((k > 0 && stale >= stop.patience) || (stop.max_hops > 0 && local.hops >= stop.max_hops)) {
+            ++local.early_stops;
+            break;
+        }
+        frontier.pop();
+        ++local.hops;
+        bool changed = false;
+
+        const size_t deg = g.neighbors(c.second, nbrs.data());
+        for (size_t i = 0; i < deg; ++i) {
+            if (i + 1 < deg) {
+                g.prefetch(nbrs[i + 1]);
+            }
+            const uint32_t v = nbrs[i];
+            if (!visited.visit(v)) {
+                continue;
+            }
+            const float d = dist(v);
+            ++local.distances;
+            if (best.size() < ef || d < best.top().first) {
+                frontier.emplace(d, v);
+                best.emplace(d, v);
+                changed |= improves(d);
+                if (best.size() > ef) {
+                    best.pop();
+                }
+            }
+        }
+        stale = changed ? 0 : stale + 1;
+    }
+
+    std::vector<neighbor> out(best.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = {best.top().first, static_cast<idx_t>(best.top().second)};
+        best.pop();
+    }
+    if (stats) {
+        stats->hops += local.hops;
+        stats->distances += local.distances;
+        stats->early_stops += local.early_stops;
+    }
+    return out;
+}
+
+// Predicate-aware search (ACORN-style). Only nodes passing `pass(v)` enter
+// the results, but every node routes: the search keeps a beam of the ef
+// closest nodes of any kind and expands them whether they pass or not, plus
+// every passing node that improves the results, so it keeps walking toward
+// the query and through regions the filter empties. When a neighbor fails,
+// its passing neighbors are also looked at directly (at most g.max_degree()
+// of them per expansion), which reaches the subgraph induced by a selective
+// filter without a detour through failing nodes. The search stops once no
+// candidate lies within the routing beam or, with ef results found, within
+// the results. Pair this with a denser graph (graph_params::gamma) when
+// filters pass few nodes.
+template <typename Graph, typename DistFn, typename Pred>
+std::vector<neighbor> filtered_beam_search(const Graph & g, DistFn && dist, Pred && pass, const uint32_t * entries,
+                                           size_t n_entries, size_t ef, visited_list & visited,
+                                           search_stats * stats = nullptr) {
+    using cand = std::pair<float, uint32_t>;
+    std::priority_queue<cand, std::vector<cand>, std::greater<cand>> frontier; // closest first
+    std::priority_queue<cand>                                        best;     // farthest passing first
+    std::priority_queue<float>                                       beam;     // routing beam, farthest first
+
+    ef = std::max<size_t>(ef, 1);
+    search_stats local;
+    auto         in_beam = [&](float d) { return beam.size() < ef || d < beam.top(); };
+    auto         in_best = [&](float d) { return best.size() < ef || d < best.top().first; };
+    // Queues v for expansion if it joins the routing beam or the results.
+    auto consider = [&](uint32_t v, float d, bool passes) {
+        const bool routes = in_beam(d);
+        if (routes) {
+            beam.push(d);
+            if (beam.size() > ef) {
+                beam.pop();
+            }
+        }
+        const bool keeps = passes && in_best(d);
+        if (keeps) {
+            best.emplace(d, v);
+            if (best.size() > ef) {
+                best.pop();
+            }
+        }
+        if (routes || keeps) {
+            frontier.emplace(d, v);
+        }
+    };
+    for (size_t i = 0; i < n_entries; ++i) {
+        if (entries[i] < g.size() && visited.visit(entries[i])) {
+            ++local.distances;
+            consider(entries[i], dist(entries[i]), pass(entries[i]));
+        }
+    }
+
+    const size_t          width = g.max_degree();
+    std::vector<uint32_t> nbrs(width), hop2(width);
+    while (!frontier.empty()) {
+        const cand c = frontier.top();
+        if (!in_beam(c.first) && !(best.size() < ef || c.first <= best.top().first)) {
+            break;
+        }
+        frontier.pop();
+        ++local.hops;
+
+        const size_t deg    = g.neighbors(c.second, nbrs.data());
+        size_t       looked = 0;
+        for (size_t i = 0; i < deg; ++i) {
+            if (i + 1 < deg) {
+                g.prefetch(nbrs[i + 1]);
+            }
+            const uint32_t u = nbrs[i];
+            if (!visited.visit(u)) {
+                continue;
+            }
+            const bool passes = pass(u);
+            ++local.distances;
+            consider(u, dist(u), passes);
+            if (passes || looked >= width) {
+                continue;
+            }
+            // u fails the filter: look through it to its passing neighbors.
+            const size_t deg2 = g.neighbors(u, hop2.data());
+            for (size_t j = 0; j < deg2 && looked < width; ++j) {
+                const uint32_t w = hop2[j];
+                if (pass(w) && visited.visit(w)) {
+                    ++looked;
+                    ++local.distances;
+                    consider(w, dist(w), true);
+                }
+            }
+        }
+    }
+
+    std::vector<neighbor> out(best.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = {best.top().first, static_cast<idx_t>(best.top().second)};
+        best.pop();
+    }
+    if (stats) {
+        stats->hops += local.hops;
+        stats->distances += local.distances;
+    }
+    return out;
+}
+
+} // namespace e4b
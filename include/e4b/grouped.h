@@ -0,0 +1,194 @@
+// e4b: Embedding database in C/C++
+// Grouped search: the top g groups by best hit, up to n hits per group
+// (e.g. documents ranked by their best chunk).
+//
+// group_collector keeps every group's n best hits and tracks the bound past
+// which a hit can no longer change the answer: the best hit of the g-th
+// group (a new group must beat it to enter), or the n-th hit of a full top
+// group, whichever is larger. Groups still short of n hits do not hold the
+// bound open, otherwise a single-chunk document would force a full scan.
+//
+// grouped_beam_search feeds the collector from a graph traversal and keeps
+// expanding past the ef beam while the bound is open, so it runs until g
+// distinct groups are found instead of over-fetching and deduplicating.
+#pragma once
+
+#include "graph_index.h"
+#include "graph_search.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+struct group_result {
+    idx_t                 group = -1;
+    std::vector<neighbor> hits; // ascending distance, at most n
+};
+
+class group_collector {
+public:
+    group_collector(size_t groups, size_t per_group) :
+        g_(std::max<size_t>(groups, 1)),
+        n_(std::max<size_t>(per_group, 1)) {}
+
+    // Hits at or beyond this distance cannot change the result.
+    float bound() const { return bound_; }
+
+    // Returns true if the hit was kept.
+    bool push(float dist, idx_t id, idx_t group) {
+        if (!(dist < bound_)) {
+            // Still useful for a top group that is not full yet.
+            auto it = groups_.find(group);
+            if (it == groups_.end() || it->second.size() >= n_ || !in_top(group, it->second.front().dist)) {
+                return false;
+            }
+        }
+        std::vector<neighbor> & hits = groups_[group];
+        if (hits.size() >= n_ && !(neighbor{dist, id} < hits.back())) {
+            return false;
+        }
+        const float old_best = hits.empty() ? std::numeric_limits<float>::infinity() : hits.front().dist;
+        hits.insert(std::upper_bound(hits.begin(), hits.end(), neighbor{dist, id}), neighbor{dist, id});
+        if (hits.size() > n_) {
+            hits.pop_back();
+        }
+        if (hits.front().dist < old_best) {
+            if (old_best != std::numeric_limits<float>::infinity()) {
+                ranking_.erase({old_best, group});
+            }
+            ranking_.insert({hits.front().dist, group});
+        }
+        update_bound();
+        return true;
+    }
+
+    size_t group_count() const { return groups_.size(); }
+
+    // The top g groups, best first.
+    std::vector<group_result> results() const {
+        std::vector<group_result> out;
+        for (auto it = ranking_.begin(); it != ranking_.end() && out.size() < g_; ++it) {
+            out.push_back({it->second, groups_.at(it->second)});
+        }
+        return out;
+    }
+
+private:
+    bool in_top(idx_t group, float best) const {
+        size_t rank = 0;
+        for (auto it = ranking_.begin(); it != ranking_.end() && rank < g_; ++it, ++rank) {
+            if (it->second == group && it->first == best) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void update_bound() {
+        if (ranking_.size() < g_) {
+            bound_ = std::numeric_limits<float>::infinity();
+            return;
+        }
+        float  b    = -std::numeric_limits<float>::infinity();
+        size_t rank = 0;
+        for (auto it = ranking_.begin(); rank < g_; ++it, ++rank) {
+            const std::vector<neighbor> & hits = groups_.at(it->second);
+            b                                  = std::max(b, hits.size() >= n_ ? hits.back().dist : it->first);
+        }
+        bound_ = b;
+    }
+
+    size_t                                           g_, n_;
+    std::unordered_map<idx_t, std::vector<neighbor>> groups_;
+    std::set<std::pair<float, idx_t>>                ranking_; // (best distance, group)
+    float                                            bound_ = std::numeric_limits<float>::infinity();
+};
+
+// Beam search feeding `out`; group_of(v) is the group of node v. Nodes enter
+// the frontier while they improve the ef beam or fall inside the collector's
+// bound, and the search stops once both are settled.
+template <typename Graph, typename DistFn, typename GroupFn>
+void grouped_beam_search(const Graph & g, DistFn && dist, GroupFn && group_of, const uint32_t * entries,
+                         size_t n_entries, size_t ef, group_collector & out, visited_list & visited,
+                         search_stats * stats = nullptr) {
+    using cand = std::pair<float, uint32_t>;
+    std::priority_queue<cand, std::vector<cand>, std::greater<cand>> frontier; // closest first
+    std::priority_queue<float>                                       beam;     // farthest first
+
+    ef = std::max<size_t>(ef, 1);
+    search_stats local;
+    auto         consider = [&](uint32_t v, float d) {
+        const bool in_beam = beam.size() < ef || d < beam.top();
+        if (in_beam) {
+            beam.push(d);
+            if (beam.size() > ef) {
+                beam.pop();
+            }
+        }
+        // Hits that only fill a short group are kept but not expanded from.
+        out.push(d, static_cast<idx_t>(v), group_of(v));
+        if (in_beam || d < out.bound()) {
+            frontier.emplace(d, v);
+        }
+    };
+    for (size_t i = 0; i < n_entries; ++i) {
+        if (entries[i] < g.size() && visited.visit(entries[i])) {
+            ++local.distances;
+            consider(entries[i], dist(entries[i]));
+        }
+    }
+
+    std::vector<uint32_t> nbrs(g.max_degree());
+    while (!frontier.empty()) {
+        const cand c = frontier.top();
+        if (beam.size() >= ef && c.first > beam.top() && !(c.first < out.bound())) {
+            break;
+        }
+        frontier.pop();
+        ++local.hops;
+
+        const size_t deg = g.neighbors(c.second, nbrs.data());
+        for (size_t i = 0; i < deg; ++i) {
+            if (i + 1 < deg) {
+                g.prefetch(nbrs[i + 1]);
+            }
+            const uint32_t v = nbrs[i];
+            if (!visited.visit(v)) {
+                continue;
+            }
+            ++local.distances;
+            consider(v, dist(v));
+        }
+    }
+    if (stats) {
+        stats->hops += local.hops;
+        stats->distances += local.distances;
+    }
+}
+
+// Grouped search over a graph_index. Hit ids are node ids; group_of maps a
+// node to its group.
+template <typename GroupFn>
+std::vector<group_result> search_grouped(const graph_index & index, const float * q, size_t groups, size_t per_group,
+                                         size_t ef, GroupFn && group_of, search_stats * stats = nullptr) {
+    group_collector out(groups, per_group);
+    if (index.size() == 0 || groups == 0) {
+        return {};
+    }
+    const uint32_t entry   = index.entry();
+    visited_list & visited = thread_visited(index.size());
+    grouped_beam_search(index.graph(), index.dist_to(q), group_of, &entry, 1, ef, out, visited, stats);
+    return out.results();
+}
+
+} // namespace e4b
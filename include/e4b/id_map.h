@@ -0,0 +1,511 @@
+// e4b: Embedding database in C/C++
+// External id -> dense internal id map (Swiss-table layout).
+//
+// Open addressing over groups of 16 slots. Every slot has a control byte:
+// empty, deleted, or the low 7 bits of the key's hash. A lookup loads the 16
+// control bytes of a group at once, compares them against the hash byte with
+// one SSE2 compare, and only touches the keys whose byte matched; a group
+// with an empty slot ends the probe. Keys and values live in separate flat
+// arrays (8 + 4 bytes per slot, plus one control byte), so the table is 13
+// bytes per slot, and 15 to 30 bytes per id as the load moves between 7/16
+// and 7/8.
+//
+// swiss_id_map<uint64_t> stores the keys inline. swiss_id_map<std::string_view>
+// (string UUIDs, ...) stores each key once in a byte arena and keeps its
+// offset in the slot.
+//
+// save() writes the arrays verbatim; map() opens such a file read-only and
+// serves lookups straight from the mapping, without a load step.
+//
+// File layout (little-endian):
+//   header (64 bytes): magic "E4BIDMP1", u32 key kind, u32 0, u64 capacity,
+//                      u64 size, u64 tombstones, u64 next_id, u64 arena bytes
+//   i8  ctrl[capacity]
+//   u64 keys[capacity]
+//   u32 values[capacity], padded to 8 bytes
+//   arena
+#pragma once
+
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#    include <immintrin.h>
+#endif
+
+namespace e4b {
+
+constexpr uint32_t id_map_absent = UINT32_MAX;
+
+namespace detail {
+
+constexpr size_t id_group      = 16;
+constexpr int8_t id_ctrl_empty = -128; // 0x80
+constexpr int8_t id_ctrl_dead  = -2;   // 0xFE
+
+constexpr char id_map_magic[8] = {'E', '4', 'B', 'I', 'D', 'M', 'P', '1'};
+
+inline uint64_t id_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t id_hash(uint64_t k) {
+    return id_mix(k);
+}
+
+inline uint64_t id_hash(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+    for (char c : s) {
+        h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return id_mix(h);
+}
+
+// Bit i set when ctrl[i] == b.
+inline uint32_t group_match(const int8_t * ctrl, int8_t b) {
+#if defined(__SSE2__)
+    const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(b))));
+#else
+    uint32_t m = 0;
+    for (size_t i = 0; i < id_group; ++i) {
+        m |= static_cast<uint32_t>(ctrl[i] == b) << i;
+    }
+    return m;
+#endif
+}
+
+// Bit i set when slot i is empty or deleted (sign bit of the control byte).
+inline uint32_t group_free(const int8_t * ctrl) {
+#if defined(__SSE2__)
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl))));
+#else
+    uint32_t m = 0;
+    for (size_t i = 0; i < id_group; ++i) {
+        m |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+    }
+    return m;
+#endif
+}
+
+inline unsigned lowest_bit(uint32_t m) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctz(m));
+#else
+    unsigned i = 0;
+    while (!(m & 1u)) {
+        m >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+} // namespace detail
+
+template <typename Key>
+class swiss_id_map {
+    static_assert(std::is_same_v<Key, uint64_t> || std::is_same_v<Key, std::string_view>,
+                  "swiss_id_map: keys are uint64_t or std::string_view");
+
+    static constexpr bool string_keys = std::is_same_v<Key, std::string_view>;
+
+public:
+    swiss_id_map() = default;
+
+    swiss_id_map(const swiss_id_map &)             = delete;
+    swiss_id_map & operator=(const swiss_id_map &) = delete;
+    // Moving keeps the buffers, hence the views into them.
+    swiss_id_map(swiss_id_map &&) noexcept             = default;
+    swiss_id_map & operator=(swiss_id_map &&) noexcept = default;
+
+    size_t   size() const { return size_; }
+    size_t   capacity() const { return cap_; }
+    uint32_t next_id() const { return next_id_; }
+    bool     read_only() const { return file_.is_open(); }
+
+    // Internal id of k, or id_map_absent.
+    uint32_t find(Key k) const {
+        const size_t s = find_slot(k, detail::id_hash(k));
+        return s == npos ? id_map_absent : vals_[s];
+    }
+
+    bool contains(Key k) const { return find(k) != id_map_absent; }
+
+    // Maps k to `value` unless k is present; returns the mapped value and
+    // whether it was inserted. `value` may not be id_map_absent.
+    std::pair<uint32_t, bool> insert(Key k, uint32_t value) {
+        check_writable();
+        check_value(value);
+        const uint64_t h = detail::id_hash(k);
+        const size_t   s = find_slot(k, h);
+        if (s != npos) {
+            return {vals_[s], false};
+        }
+        place(k, h, value);
+        if (value >= next_id_) {
+            next_id_ = value + 1;
+        }
+        return {value, true};
+    }
+
+    // Maps k to the next dense internal id unless k is present.
+    std::pair<uint32_t, bool> assign(Key k) {
+        if (next_id_ == id_map_absent) {
+            throw std::length_error("swiss_id_map: internal ids exhausted");
+        }
+        return insert(k, next_id_);
+    }
+
+    // Maps k to `value`, replacing any previous mapping; returns the previous
+    // value or id_map_absent. `value` may not be id_map_absent.
+    uint32_t set(Key k, uint32_t value) {
+        check_writable();
+        check_value(value);
+        const uint64_t h = detail::id_hash(k);
+        const size_t   s = find_slot(k, h);
+        if (s != npos) {
+            return std::exchange(vals_v_[s], value);
+        }
+        place(k, h, value);
+        if (value >= next_id_) {
+            next_id_ = value + 1;
+        }
+        return id_map_absent;
+    }
+
+    // Removes k; its internal id is not handed out again.
+    bool erase(Key k) {
+        check_writable();
+        const size_t s = find_slot(k, detail::id_hash(k));
+        if (s == npos) {
+            return false;
+        }
+        ctrl_v_[s] = detail::id_ctrl_dead;
+        --size_;
+        ++tombstones_;
+        return true;
+    }
+
+    // fn(key, value) for every live entry, in slot order.
+    template <typename F>
+    void for_each(F && fn) const {
+        for (size_t s = 0; s < cap_; ++s) {
+            if (ctrl_[s] >= 0) {
+                fn(key_at(s), vals_[s]);
+            }
+        }
+    }
+
+    size_t memory_bytes() const { return cap_ * (1 + sizeof(uint64_t) + sizeof(uint32_t)) + arena_bytes_; }
+
+    double bytes_per_id() const {
+        return size_ == 0 ? 0.0 : static_cast<double>(memory_bytes()) / static_cast<double>(size_);
+    }
+
+    // Written to a temporary and renamed, so a crash never leaves a torn map.
+    void save(const std::string & path) const {
+        const std::string tmp = path + ".tmp";
+        std::FILE *       f   = std::fopen(tmp.c_str(), "wb");
+        if (!f) {
+            throw std::system_error(errno, std::generic_category(), "id_map: open " + tmp);
+        }
+        try {
+            uint8_t header[header_bytes] = {};
+            std::memcpy(header, detail::id_map_magic, sizeof(detail::id_map_magic));
+            const uint32_t kind      = string_keys ? 1 : 0;
+            const uint64_t fields[5] = {cap_, size_, tombstones_, next_id_, arena_bytes_};
+            std::memcpy(header + 8, &kind, sizeof(kind));
+            std::memcpy(header + 16, fields, sizeof(fields));
+            write(f, header, sizeof(header));
+            write(f, ctrl_, cap_);
+            write(f, keys_, cap_ * sizeof(uint64_t));
+            write(f, vals_, cap_ * sizeof(uint32_t));
+            const uint8_t pad[8] = {};
+            write(f, pad, padding(cap_ * sizeof(uint32_t)));
+            write(f, arena_, arena_bytes_);
+        } catch (...) {
+            std::fclose(f);
+            std::remove(tmp.c_str());
+            throw;
+        }
+        if (std::fclose(f) != 0 || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            throw std::system_error(errno, std::generic_category(), "id_map: save " + path);
+        }
+    }
+
+    // Reads a saved map into memory; the result is writable.
+    static swiss_id_map load(const std::string & path) {
+        swiss_id_map mapped = map(path);
+        swiss_id_map m;
+        m.ctrl_v_.assign(mapped.ctrl_, mapped.ctrl_ + mapped.cap_);
+        m.keys_v_.assign(mapped.keys_, mapped.keys_ + mapped.cap_);
+        m.vals_v_.assign(mapped.vals_, mapped.vals_ + mapped.cap_);
+        m.arena_v_.assign(mapped.arena_, mapped.arena_ + mapped.arena_bytes_);
+        m.cap_         = mapped.cap_;
+        m.size_        = mapped.size_;
+        m.tombstones_  = mapped.tombstones_;
+        m.next_id_     = mapped.next_id_;
+        m.arena_bytes_ = mapped.arena_bytes_;
+        m.bind();
+        return m;
+    }
+
+    // Serves lookups straight from a read-only mapping of a saved map. The
+    // header is checked against the file size and the control bytes are
+    // scanned (plus every key's arena range for string keys), so a corrupt
+    // file is rejected here rather than read out of bounds or probed forever.
+    static swiss_id_map map(const std::string & path) {
+        swiss_id_map m;
+        m.file_            = mapped_file::open(path);
+        const uint8_t * p  = m.file_.data();
+        const size_t    sz = m.file_.size();
+        if (sz < header_bytes || std::memcmp(p, detail::id_map_magic, sizeof(detail::id_map_magic)) != 0) {
+            throw std::runtime_error("id_map: bad magic in " + path);
+        }
+        uint32_t kind = 0;
+        uint64_t fields[5];
+        std::memcpy(&kind, p + 8, sizeof(kind));
+        std::memcpy(fields, p + 16, sizeof(fields));
+        if (kind != (string_keys ? 1u : 0u)) {
+            throw std::runtime_error("id_map: key kind mismatch in " + path);
+        }
+        // Each field is at most the file size, so the sums below cannot overflow.
+        for (uint64_t v : fields) {
+            if (v > sz) {
+                throw std::runtime_error("id_map: corrupt header in " + path);
+            }
+        }
+        m.cap_         = static_cast<size_t>(fields[0]);
+        m.size_        = static_cast<size_t>(fields[1]);
+        m.tombstones_  = static_cast<size_t>(fields[2]);
+        m.next_id_     = static_cast<uint32_t>(fields[3]);
+        m.arena_bytes_ = static_cast<size_t>(fields[4]);
+        const size_t groups = m.cap_ / detail::id_group;
+        // find_slot() masks with groups - 1: a power of two (or an empty map).
+        if (m.cap_ % detail::id_group != 0 || (groups & (groups - 1)) != 0 || (m.cap_ == 0 && m.size_ != 0) ||
+            m.size_ + m.tombstones_ > m.cap_) {
+            throw std::runtime_error("id_map: corrupt header in " + path);
+        }
+        const size_t vals_end = header_bytes + m.cap_ * (1 + sizeof(uint64_t) + sizeof(uint32_t));
+        if (sz < vals_end + padding(m.cap_ * sizeof(uint32_t)) + m.arena_bytes_) {
+            throw std::runtime_error("id_map: truncated " + path);
+        }
+        m.ctrl_  = reinterpret_cast<const int8_t *>(p + header_bytes);
+        m.keys_  = reinterpret_cast<const uint64_t *>(p + header_bytes + m.cap_);
+        m.vals_  = reinterpret_cast<const uint32_t *>(p + header_bytes + m.cap_ * (1 + sizeof(uint64_t)));
+        m.arena_ = reinterpret_cast<const char *>(p + vals_end + padding(m.cap_ * sizeof(uint32_t)));
+        m.validate(path);
+        return m;
+    }
+
+private:
+    static constexpr size_t npos         = SIZE_MAX;
+    static constexpr size_t header_bytes = 64;
+
+    static size_t padding(size_t bytes) { return (8 - bytes % 8) % 8; }
+
+    static void write(std::FILE * f, const void * p, size_t n) {
+        if (n > 0 && std::fwrite(p, n, 1, f) != 1) {
+            throw std::system_error(errno, std::generic_category(), "id_map: write");
+        }
+    }
+
+    static void check_value(uint32_t value) {
+        if (value == id_map_absent) {
+            throw std::invalid_argument("swiss_id_map: id_map_absent is not a valid value");
+        }
+    }
+
+    // Slot-level checks of a mapped file: live and dead counts match the
+    // header, an empty slot ends every probe, and string keys lie in the arena.
+    void validate(const std::string & path) const {
+        size_t live = 0, dead = 0;
+        for (size_t s = 0; s < cap_; ++s) {
+            const int8_t c = ctrl_[s];
+            if (c >= 0) {
+                ++live;
+                if constexpr (string_keys) {
+                    uint32_t len = 0;
+                    if (keys_[s] > arena_bytes_ || arena_bytes_ - keys_[s] < sizeof(len)) {
+                        throw std::runtime_error("id_map: key outside the arena in " + path);
+                    }
+                    std::memcpy(&len, arena_ + keys_[s], sizeof(len));
+                    if (arena_bytes_ - keys_[s] - sizeof(len) < len) {
+                        throw std::runtime_error("id_map: key outside the arena in " + path);
+                    }
+                }
+            } else if (c == detail::id_ctrl_dead) {
+                ++dead;
+            } else if (c != detail::id_ctrl_empty) {
+                throw std::runtime_error("id_map: bad control byte in " + path);
+            }
+        }
+        if (live != size_ || dead != tombstones_ || (cap_ != 0 && live + dead == cap_)) {
+            throw std::runtime_error("id_map: corrupt table in " + path);
+        }
+    }
+
+    void check_writable() const {
+        if (read_only()) {
+            throw std::logic_error("swiss_id_map: mapped maps are read-only");
+        }
+    }
+
+    // Points the read views at the owned buffers.
+    void bind() {
+        ctrl_  = ctrl_v_.data();
+        keys_  = keys_v_.data();
+        vals_  = vals_v_.data();
+        arena_ = arena_v_.data();
+    }
+
+    Key key_at(size_t s) const {
+        if constexpr (string_keys) {
+            uint32_t len = 0;
+            std::memcpy(&len, arena_ + keys_[s], sizeof(len));
+            return std::string_view(arena_ + keys_[s] + sizeof(len), len);
+        } else {
+            return keys_[s];
+        }
+    }
+
+    size_t find_slot(Key k, uint64_t h) const {
+        if (cap_ == 0) {
+            return npos;
+        }
+        const size_t mask = cap_ / detail::id_group - 1;
+        const int8_t h2   = static_cast<int8_t>(h & 0x7f);
+        size_t       g    = static_cast<size_t>(h >> 7) & mask;
+        // Triangular steps visit every group of a power-of-two table.
+        for (size_t step = 1;; ++step) {
+            const int8_t * c = ctrl_ + g * detail::id_group;
+            for (uint32_t m = detail::group_match(c, h2); m != 0; m &= m - 1) {
+                const size_t s = g * detail::id_group + detail::lowest_bit(m);
+                if (key_at(s) == k) {
+                    return s;
+                }
+            }
+            if (detail::group_match(c, detail::id_ctrl_empty) != 0) {
+                return npos;
+            }
+            g = (g + step) & mask;
+        }
+    }
+
+    // Inserts a key known to be absent.
+    void place(Key k, uint64_t h, uint32_t value) {
+        // Keep at least 1/8 of the slots empty so every probe terminates.
+        if ((size_ + tombstones_ + 1) * 8 > cap_ * 7) {
+            rehash(cap_ == 0 ? detail::id_group : ((size_ + 1) * 16 > cap_ * 7 ? cap_ * 2 : cap_));
+        }
+        uint64_t stored;
+        if constexpr (string_keys) {
+            if (k.size() > UINT32_MAX) {
+                throw std::length_error("swiss_id_map: key too long");
+            }
+            stored             = arena_bytes_;
+            const uint32_t len = static_cast<uint32_t>(k.size());
+            arena_v_.resize(arena_bytes_ + sizeof(len) + len);
+            std::memcpy(arena_v_.data() + arena_bytes_, &len, sizeof(len));
+            std::memcpy(arena_v_.data() + arena_bytes_ + sizeof(len), k.data(), len);
+            arena_bytes_ = arena_v_.size();
+            arena_       = arena_v_.data();
+        } else {
+            stored = k;
+        }
+        put(h, stored, value);
+        ++size_;
+    }
+
+    // Writes into the first free slot of h's probe sequence.
+    void put(uint64_t h, uint64_t stored, uint32_t value) {
+        const size_t mask = cap_ / detail::id_group - 1;
+        size_t       g    = static_cast<size_t>(h >> 7) & mask;
+        for (size_t step = 1;; ++step) {
+            const uint32_t m = detail::group_free(ctrl_ + g * detail::id_group);
+            if (m != 0) {
+                const size_t s = g * detail::id_group + detail::lowest_bit(m);
+                if (ctrl_v_[s] == detail::id_ctrl_dead) {
+                    --tombstones_;
+                }
+                ctrl_v_[s] = static_cast<int8_t>(h & 0x7f);
+                keys_v_[s] = stored;
+                vals_v_[s] = value;
+                return;
+            }
+            g = (g + step) & mask;
+        }
+    }
+
+    // Rebuilds into new_cap slots, dropping tombstones and dead arena bytes.
+    void rehash(size_t new_cap) {
+        std::vector<int8_t>   ctrl(new_cap, detail::id_ctrl_empty);
+        std::vector<uint64_t> keys(new_cap);
+        std::vector<uint32_t> vals(new_cap);
+        std::vector<char>     arena;
+        std::swap(ctrl, ctrl_v_);
+        std::swap(keys, keys_v_);
+        std::swap(vals, vals_v_);
+        std::swap(arena, arena_v_);
+        const size_t old_cap = cap_;
+        cap_                 = new_cap;
+        tombstones_          = 0;
+        arena_bytes_         = 0;
+        bind();
+        for (size_t s = 0; s < old_cap; ++s) {
+            if (ctrl[s] < 0) {
+                continue;
+            }
+            if constexpr (string_keys) {
+                uint32_t len = 0;
+                std::memcpy(&len, arena.data() + keys[s], sizeof(len));
+                const size_t at = arena_v_.size();
+                arena_v_.insert(arena_v_.end(), arena.data() + keys[s], arena.data() + keys[s] + sizeof(len) + len);
+                put(detail::id_hash(std::string_view(arena.data() + keys[s] + sizeof(len), len)), at, vals[s]);
+            } else {
+                put(detail::id_hash(keys[s]), keys[s], vals[s]);
+            }
+        }
+        arena_bytes_ = arena_v_.size();
+        bind();
+    }
+
+    std::vector<int8_t>   ctrl_v_;
+    std::vector<uint64_t> keys_v_;
+    std::vector<uint32_t> vals_v_;
+    std::vector<char>     arena_v_;
+    mapped_file           file_; // open for mapped maps
+
+    const int8_t *   ctrl_        = nullptr;
+    const uint64_t * keys_        = nullptr;
+    const uint32_t * vals_        = nullptr;
+    const char *     arena_       = nullptr;
+    size_t           cap_         = 0;
+    size_t           size_        = 0;
+    size_t           tombstones_  = 0;
+    size_t           arena_bytes_ = 0;
+    uint32_t         next_id_     = 0;
+};
+
+using id_map        = swiss_id_map<uint64_t>;
+using string_id_map = swiss_id_map<std::string_view>;
+
+} // namespace e4b
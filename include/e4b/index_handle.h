@@ -0,0 +1,118 @@
+// e4b: Embedding database in C/C++
+// Atomically swappable, reference-counted index for zero-downtime rebuilds.
+//
+// Readers call acquire() once per query and keep the returned shared_ptr for
+// the duration of the query. A rebuild constructs the replacement off to the
+// side and publish() exchanges the pointer: new queries see the new index
+// immediately, queries already in flight finish on the old one, and the old
+// index (with the memory it had reserved) is released when the last of them
+// drops its reference. acquire() never waits for a rebuild or a publish();
+// the only lock it can meet is atomic_shared_ptr's, held for a reference
+// count update.
+#pragma once
+
+#include "atomic_shared_ptr.h"
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+template <typename Index>
+class index_handle {
+public:
+    using builder = std::function<std::shared_ptr<const Index>()>;
+
+    explicit index_handle(std::shared_ptr<const Index> initial, memory_reservation mem = {})
+        : current_(make_version(std::move(initial), std::move(mem), 0)) {}
+
+    index_handle(const index_handle &)             = delete;
+    index_handle & operator=(const index_handle &) = delete;
+
+    ~index_handle() {
+        if (rebuild_.valid()) {
+            rebuild_.wait();
+        }
+    }
+
+    std::shared_ptr<const Index> acquire() const {
+        std::shared_ptr<const version> v = current_.load(std::memory_order_acquire);
+        return std::shared_ptr<const Index>(v, v->index.get());
+    }
+
+    uint64_t generation() const { return current_.load(std::memory_order_acquire)->generation; }
+
+    // Makes `next` visible to new readers and returns the new generation.
+    uint64_t publish(std::shared_ptr<const Index> next, memory_reservation mem = {}) {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        const uint64_t              gen = current_.load(std::memory_order_relaxed)->generation + 1;
+        std::shared_ptr<const version> old =
+            current_.exchange(make_version(std::move(next), std::move(mem), gen), std::memory_order_acq_rel);
+        retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                      [](const std::weak_ptr<const version> & w) { return w.expired(); }),
+                       retired_.end());
+        retired_.push_back(old);
+        return gen;
+    }
+
+    // Retired versions still referenced by in-flight queries.
+    size_t retired_in_flight() const {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        return static_cast<size_t>(std::count_if(retired_.begin(), retired_.end(),
+                                                 [](const std::weak_ptr<const version> & w) { return !w.expired(); }));
+    }
+
+    // Builds a replacement on a background thread while the current index keeps
+    // serving, then publishes it. `bytes` of the given kind are reserved up
+    // front so that the old and new copies are both accounted while they
+    // coexist; the future throws std::bad_alloc if the governor refuses them.
+    // Only one rebuild runs at a time: a second call waits for the first.
+    std::shared_future<uint64_t> rebuild_async(builder build, memory_governor * gov = nullptr, size_t bytes = 0,
+                                               memory_kind kind = memory_kind::vectors) {
+        std::lock_guard<std::mutex> lock(rebuild_mutex_);
+        if (rebuild_.valid()) {
+            rebuild_.wait();
+        }
+        rebuild_ = std::async(std::launch::async, [this, build = std::move(build), gov, bytes, kind] {
+                       memory_reservation mem;
+                       if (gov && bytes > 0) {
+                           mem = memory_reservation(*gov, kind, bytes);
+                       }
+                       return publish(build(), std::move(mem));
+                   }).share();
+        return rebuild_;
+    }
+
+private:
+    struct version {
+        std::shared_ptr<const Index> index;
+        memory_reservation           mem;
+        uint64_t                     generation;
+    };
+
+    static std::shared_ptr<const version> make_version(std::shared_ptr<const Index> index, memory_reservation mem,
+                                                       uint64_t gen) {
+        auto v        = std::make_shared<version>();
+        v->index      = std::move(index);
+        v->mem        = std::move(mem);
+        v->generation = gen;
+        return v;
+    }
+
+    atomic_shared_ptr<const version>           current_;
+    mutable std::mutex                         publish_mutex_;
+    std::vector<std::weak_ptr<const version>>  retired_;
+    std::mutex                                 rebuild_mutex_;
+    std::shared_future<uint64_t>               rebuild_;
+};
+
+} // namespace e4b
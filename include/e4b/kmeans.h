@@ -0,0 +1,155 @@
+// e4b: Embedding database in C/C++
+// Lloyd k-means with an optional size-balance penalty, and the hierarchical
+// balanced variant used to cut a collection into bounded posting lists.
+#pragma once
+
+#include "distance.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace e4b {
+
+struct kmeans_params {
+    size_t   iters   = 10;
+    float    balance = 0.0f; // > 0 penalizes assignments to oversized clusters
+    uint64_t seed    = 1234;
+};
+
+// Clusters the rows of x listed in `rows` into k centroids, returned
+// row-major. `assign`, if given, receives the cluster of each listed row.
+// Always squared L2.
+inline std::vector<float> kmeans(const float * x, size_t d, const std::vector<uint32_t> & rows, size_t k,
+                                 const kmeans_params & p = {}, std::vector<uint32_t> * assign = nullptr) {
+    check_dim(d);
+    const size_t n = rows.size();
+    if (k == 0 || n < k) {
+        throw std::invalid_argument("kmeans: need 0 < k <= number of rows");
+    }
+    std::mt19937_64 rng(p.seed);
+
+    std::vector<uint32_t> init(n);
+    std::iota(init.begin(), init.end(), 0u);
+    std::shuffle(init.begin(), init.end(), rng);
+    std::vector<float> cent(k * d);
+    for (size_t c = 0; c < k; ++c) {
+        std::copy_n(x + static_cast<size_t>(rows[init[c]]) * d, d, cent.begin() + c * d);
+    }
+
+    std::vector<uint32_t> a(n, 0);
+    std::vector<size_t>   count(k, n / k);
+    std::vector<double>   sum(k * d);
+    const double          fair      = static_cast<double>(n) / static_cast<double>(k);
+    float                 mean_dist = 0; // unknown in the first round, so no penalty yet
+    for (size_t it = 0; it < p.iters; ++it) {
+        // Assignment; the balance term is scaled by the mean distance of the previous round.
+        double mean = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const float * v    = x + static_cast<size_t>(rows[i]) * d;
+            float         best = std::numeric_limits<float>::max();
+            float         raw  = 0;
+            for (size_t c = 0; c < k; ++c) {
+                const float dist = l2_sqr(v, cent.data() + c * d, d);
+                const float cost = p.balance > 0 ? dist + p.balance * mean_dist * static_cast<float>(count[c] / fair)
+                                                 : dist;
+                if (cost < best) {
+                    best = cost;
+                    raw  = dist;
+                    a[i] = static_cast<uint32_t>(c);
+                }
+            }
+            mean += raw;
+        }
+        mean_dist = static_cast<float>(mean / static_cast<double>(n));
+
+        std::fill(count.begin(), count.end(), 0);
+        std::fill(sum.begin(), sum.end(), 0.0);
+        for (size_t i = 0; i < n; ++i) {
+            const float * v = x + static_cast<size_t>(rows[i]) * d;
+            ++count[a[i]];
+            for (size_t j = 0; j < d; ++j) {
+                sum[a[i] * d + j] += v[j];
+            }
+        }
+        for (size_t c = 0; c < k; ++c) {
+            if (count[c] == 0) {
+                // Reseed an empty cluster from a random row.
+                const uint32_t r = static_cast<uint32_t>(rng() % n);
+                std::copy_n(x + static_cast<size_t>(rows[r]) * d, d, cent.begin() + c * d);
+                continue;
+            }
+            for (size_t j = 0; j < d; ++j) {
+                cent[c * d + j] = static_cast<float>(sum[c * d + j] / static_cast<double>(count[c]));
+            }
+        }
+    }
+    if (assign) {
+        *assign = std::move(a);
+    }
+    return cent;
+}
+
+// Recursively splits the collection until no cluster holds more than
+// max_cluster rows, `branching` ways at a time with balanced k-means.
+// Returns the leaf centroids, row-major.
+inline std::vector<float> hierarchical_kmeans(const float * x, size_t n, size_t d, size_t max_cluster,
+                                              size_t branching = 8, kmeans_params p = {}) {
+    check_dim(d);
+    if (max_cluster == 0 || branching < 2) {
+        throw std::invalid_argument("hierarchical_kmeans: need max_cluster > 0 and branching >= 2");
+    }
+    if (p.balance <= 0) {
+        p.balance = 1.0f;
+    }
+    std::vector<float>                 leaves;
+    std::vector<std::vector<uint32_t>> todo(1);
+    todo[0].resize(n);
+    std::iota(todo[0].begin(), todo[0].end(), 0u);
+
+    while (!todo.empty()) {
+        std::vector<uint32_t> rows = std::move(todo.back());
+        todo.pop_back();
+        if (rows.empty()) {
+            continue;
+        }
+        if (rows.size() <= max_cluster) {
+            std::vector<double> mean(d, 0.0);
+            for (uint32_t r : rows) {
+                for (size_t j = 0; j < d; ++j) {
+                    mean[j] += x[static_cast<size_t>(r) * d + j];
+                }
+            }
+            for (size_t j = 0; j < d; ++j) {
+                leaves.push_back(static_cast<float>(mean[j] / static_cast<double>(rows.size())));
+            }
+            continue;
+        }
+        const size_t          k = std::min(branching, (rows.size() + max_cluster - 1) / max_cluster);
+        std::vector<uint32_t> a;
+        kmeans(x, d, rows, std::max<size_t>(k, 2), p, &a);
+        std::vector<std::vector<uint32_t>> parts(std::max<size_t>(k, 2));
+        for (size_t i = 0; i < rows.size(); ++i) {
+            parts[a[i]].push_back(rows[i]);
+        }
+        // Duplicate points can defeat k-means; halve instead so the recursion always shrinks.
+        const bool stuck = std::any_of(parts.begin(), parts.end(), [&](const auto & q) { return q.size() == rows.size(); });
+        if (stuck) {
+            parts.assign(2, {});
+            parts[0].assign(rows.begin(), rows.begin() + rows.size() / 2);
+            parts[1].assign(rows.begin() + rows.size() / 2, rows.end());
+        }
+        ++p.seed;
+        for (auto & q : parts) {
+            todo.push_back(std::move(q));
+        }
+    }
+    return leaves;
+}
+
+} // namespace e4b
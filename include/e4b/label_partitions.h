@@ -0,0 +1,153 @@
+// e4b: Embedding database in C/C++
+// Per-label sub-indexes for high-cardinality categorical filters.
+//
+// Every label (tenant id, category, ...) owns a partition holding only its
+// vectors. Small partitions are scanned flat; once a partition grows past
+// flat_threshold vectors it is promoted to its own graph_index, and later
+// inserts go straight into the graph. A query filtered on a label touches
+// only that label's partition, so selectivity never degrades recall.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "topk.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace e4b {
+
+using label_t = uint64_t;
+
+struct label_partition_params {
+    size_t       flat_threshold = 4096; // partitions above this size get a graph
+    graph_params graph;                 // graph_params::m is also the flat scan metric
+    size_t       ef = 64;               // graph search beam width
+};
+
+struct label_partition_memory {
+    size_t flat_partitions  = 0;
+    size_t graph_partitions = 0;
+    size_t flat_bytes       = 0; // vectors and ids of flat partitions
+    size_t graph_bytes      = 0; // graph_index::memory_bytes plus id maps
+    size_t overhead_bytes   = 0; // label table and per-partition bookkeeping
+    size_t vectors          = 0;
+
+    size_t total() const { return flat_bytes + graph_bytes + overhead_bytes; }
+};
+
+class label_partitioned_index {
+public:
+    label_partitioned_index(size_t dim, label_partition_params p = {}) : dim_(dim), params_(p) { check_dim(dim); }
+
+    size_t dim() const { return dim_; }
+    size_t label_count() const { return parts_.size(); }
+
+    // Number of vectors stored under `label`.
+    size_t size(label_t label) const {
+        auto it = parts_.find(label);
+        return it == parts_.end() ? 0 : it->second.ids.size();
+    }
+
+    bool has_graph(label_t label) const {
+        auto it = parts_.find(label);
+        return it != parts_.end() && it->second.graph != nullptr;
+    }
+
+    // Adds n vectors with their external ids and labels.
+    void add(const float * x, const idx_t * ids, const label_t * labels, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            partition & p = parts_[labels[i]];
+            p.ids.push_back(ids[i]);
+            if (p.graph) {
+                p.graph->add(x + i * dim_, 1);
+                continue;
+            }
+            p.data.insert(p.data.end(), x + i * dim_, x + (i + 1) * dim_);
+            if (p.ids.size() > params_.flat_threshold) {
+                promote(p);
+            }
+        }
+    }
+
+    // k nearest among the vectors labelled `label`.
+    std::vector<neighbor> search(const float * q, label_t label, size_t k, search_stats * stats = nullptr) const {
+        return search(q, &label, 1, k, stats);
+    }
+
+    // k nearest among the vectors carrying any of the given labels.
+    std::vector<neighbor> search(const float * q, const label_t * labels, size_t n_labels, size_t k,
+                                 search_stats * stats = nullptr) const {
+        if (k == 0) {
+            return {};
+        }
+        topk_collector     top(k);
+        std::vector<float> dist;
+        for (size_t l = 0; l < n_labels; ++l) {
+            auto it = parts_.find(labels[l]);
+            if (it == parts_.end()) {
+                continue;
+            }
+            const partition & p = it->second;
+            if (p.graph) {
+                for (const neighbor & r : p.graph->search(q, k, params_.ef, stats)) {
+                    top.push(r.dist, p.ids[static_cast<size_t>(r.id)]);
+                }
+                continue;
+            }
+            const size_t n = p.ids.size();
+            dist.resize(n);
+            distance_block(params_.graph.m, q, p.data.data(), n, dim_, dist.data());
+            top.push_block(dist.data(), p.ids.data(), n);
+            if (stats) {
+                stats->distances += n;
+            }
+        }
+        return top.results();
+    }
+
+    // Memory held by partitions, split by representation.
+    label_partition_memory memory() const {
+        label_partition_memory m;
+        m.overhead_bytes = parts_.bucket_count() * sizeof(void *);
+        for (const auto & kv : parts_) {
+            const partition & p = kv.second;
+            // Hash node: the entry plus next pointer and cached hash.
+            m.overhead_bytes += sizeof(kv) + 2 * sizeof(void *);
+            m.vectors += p.ids.size();
+            const size_t id_bytes = p.ids.capacity() * sizeof(idx_t);
+            if (p.graph) {
+                ++m.graph_partitions;
+                m.graph_bytes += p.graph->memory_bytes() + id_bytes + sizeof(graph_index);
+            } else {
+                ++m.flat_partitions;
+                m.flat_bytes += p.data.capacity() * sizeof(float) + id_bytes;
+            }
+        }
+        return m;
+    }
+
+private:
+    // Graph node i of a partition is ids[i]: vectors are inserted in id order.
+    struct partition {
+        std::vector<idx_t>           ids;
+        std::vector<float>           data; // flat partitions only
+        std::unique_ptr<graph_index> graph;
+    };
+
+    void promote(partition & p) const {
+        p.graph = std::make_unique<graph_index>(dim_, params_.graph);
+        p.graph->add(p.data.data(), p.ids.size());
+        std::vector<float>().swap(p.data);
+    }
+
+    size_t                                 dim_;
+    label_partition_params                 params_;
+    std::unordered_map<label_t, partition> parts_;
+};
+
+} // namespace e4b
@@ -0,0 +1,125 @@
+// e4b: Embedding database in C/C++
+// RAII wrapper around a memory-mapped file (POSIX).
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace e4b {
+
+enum class access_hint {
+    normal,
+    random,
+    sequential,
+    will_need,
+    dont_need,
+};
+
+class mapped_file {
+public:
+    enum class mode {
+        read_only,  // PROT_READ, MAP_SHARED: pages are shared through the page cache
+        read_write, // PROT_READ | PROT_WRITE, MAP_SHARED
+    };
+
+    mapped_file() = default;
+
+    static mapped_file open(const std::string & path, mode m = mode::read_only) {
+        const int fd = ::open(path.c_str(), m == mode::read_only ? O_RDONLY : O_RDWR);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "mapped_file: open " + path);
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "mapped_file: stat " + path);
+        }
+        mapped_file f;
+        f.size_ = static_cast<size_t>(st.st_size);
+        if (f.size_ > 0) {
+            const int prot = m == mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+            void *    p    = ::mmap(nullptr, f.size_, prot, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                const int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "mapped_file: mmap " + path);
+            }
+            f.data_ = static_cast<uint8_t *>(p);
+        }
+        ::close(fd);
+        f.path_ = path;
+        return f;
+    }
+
+    mapped_file(const mapped_file &)             = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    mapped_file(mapped_file && o) noexcept { swap(o); }
+
+    mapped_file & operator=(mapped_file && o) noexcept {
+        if (this != &o) {
+            close();
+            swap(o);
+        }
+        return *this;
+    }
+
+    ~mapped_file() { close(); }
+
+    bool                  is_open() const { return data_ != nullptr; }
+    const uint8_t *       data() const { return data_; }
+    uint8_t *             data() { return data_; }
+    size_t                size() const { return size_; }
+    const std::string &   path() const { return path_; }
+
+    // madvise over [offset, offset + length); length is clamped to the mapping.
+    void advise(access_hint hint, size_t offset = 0, size_t length = SIZE_MAX) const {
+        if (!data_ || offset >= size_) {
+            return;
+        }
+        static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t        begin = offset / page * page;
+        const size_t        end   = length > size_ - offset ? size_ : offset + length;
+        int                 adv   = MADV_NORMAL;
+        switch (hint) {
+            case access_hint::normal:     adv = MADV_NORMAL;     break;
+            case access_hint::random:     adv = MADV_RANDOM;     break;
+            case access_hint::sequential: adv = MADV_SEQUENTIAL; break;
+            case access_hint::will_need:  adv = MADV_WILLNEED;   break;
+            case access_hint::dont_need:  adv = MADV_DONTNEED;   break;
+        }
+        ::madvise(data_ + begin, end - begin, adv);
+    }
+
+    void close() {
+        if (data_) {
+            ::munmap(data_, size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        path_.clear();
+    }
+
+private:
+    void swap(mapped_file & o) noexcept {
+        std::swap(data_, o.data_);
+        std::swap(size_, o.size_);
+        std::swap(path_, o.path_);
+    }
+
+    uint8_t *   data_ = nullptr;
+    size_t      size_ = 0;
+    std::string path_;
+};
+
+} // namespace e4b
@@ -0,0 +1,293 @@
+// e4b: Embedding database in C/C++
+// Process-wide memory accounting with eviction and admission control.
+//
+// Every large allocation (vectors, graphs, caches, bitmaps, per-query scratch)
+// is reserved against one memory_governor before it is made. When a
+// reservation would cross the high watermark the governor runs the registered
+// evictors, cheapest first: typically caches, then collections that can be
+// unloaded back to mmap. If that still does not make room the reservation is
+// refused, or waits for memory to be released, instead of the process being
+// OOM-killed.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+enum class memory_kind : uint8_t {
+    vectors,
+    graphs,
+    caches,
+    bitmaps,
+    scratch,
+};
+
+constexpr size_t memory_kind_count = 5;
+
+inline const char * memory_kind_name(memory_kind k) {
+    switch (k) {
+        case memory_kind::vectors: return "vectors";
+        case memory_kind::graphs:  return "graphs";
+        case memory_kind::caches:  return "caches";
+        case memory_kind::bitmaps: return "bitmaps";
+        case memory_kind::scratch: return "scratch";
+    }
+    return "unknown";
+}
+
+struct memory_stats {
+    size_t                               limit = 0;
+    size_t                               used  = 0;
+    std::array<size_t, memory_kind_count> by_kind{};
+    uint64_t                             evicted_bytes = 0;
+    uint64_t                             rejected      = 0;
+};
+
+class memory_governor {
+public:
+    // Asked to free at least `bytes`; returns what it actually released through
+    // memory_governor::release (or memory_reservation::reset).
+    using evictor = std::function<size_t(size_t bytes)>;
+
+    explicit memory_governor(size_t limit, double high_watermark = 0.9) : limit_(limit) {
+        if (high_watermark <= 0.0 || high_watermark > 1.0) {
+            throw std::invalid_argument("memory_governor: high_watermark must be in (0, 1]");
+        }
+        high_ = static_cast<size_t>(static_cast<double>(limit) * high_watermark);
+    }
+
+    memory_governor(const memory_governor &)             = delete;
+    memory_governor & operator=(const memory_governor &) = delete;
+
+    size_t limit() const { return limit_; }
+    size_t used() const { return used_.load(std::memory_order_relaxed); }
+    size_t used(memory_kind k) const { return by_kind_[idx(k)].load(std::memory_order_relaxed); }
+
+    // Lower priority runs first. Returns a handle for remove_evictor().
+    // Evictors run without the registration lock held, so they may add or
+    // remove evictors themselves.
+    int add_evictor(int priority, std::string name, evictor fn) {
+        std::lock_guard<std::mutex> lock(evictors_mutex_);
+        const int                   id = next_evictor_id_++;
+        evictors_.push_back({id, priority, std::move(name), std::move(fn)});
+        std::stable_sort(evictors_.begin(), evictors_.end(),
+                         [](const entry & a, const entry & b) { return a.priority < b.priority; });
+        return id;
+    }
+
+    // An eviction pass already under way may still call the removed evictor
+    // once; it works on a copy of the list taken when it started.
+    void remove_evictor(int id) {
+        std::lock_guard<std::mutex> lock(evictors_mutex_);
+        evictors_.erase(std::remove_if(evictors_.begin(), evictors_.end(), [id](const entry & e) { return e.id == id; }),
+                        evictors_.end());
+    }
+
+    // Reserve without waiting. Runs evictors if needed; false means rejected.
+    bool try_reserve(memory_kind k, size_t bytes) {
+        if (bytes > limit_) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (!add(k, bytes, high_)) {
+            evict(used() + bytes - std::min(high_, used() + bytes));
+            if (!add(k, bytes, limit_)) {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Like try_reserve, but queues for up to `timeout` until other users release memory.
+    bool reserve(memory_kind k, size_t bytes, std::chrono::milliseconds timeout) {
+        if (try_reserve(k, bytes)) {
+            return true;
+        }
+        if (bytes > limit_) {
+            return false;
+        }
+        const auto                   deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        while (!add(k, bytes, limit_)) {
+            if (released_.wait_until(lock, deadline) == std::cv_status::timeout) {
+                if (add(k, bytes, limit_)) {
+                    break;
+                }
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void release(memory_kind k, size_t bytes) {
+        if (bytes == 0) {
+            return;
+        }
+        by_kind_[idx(k)].fetch_sub(bytes, std::memory_order_relaxed);
+        used_.fetch_sub(bytes, std::memory_order_relaxed);
+        {
+            // Pairs with the predicate check in reserve() so a wakeup is never lost.
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+        }
+        released_.notify_all();
+    }
+
+    memory_stats stats() const {
+        memory_stats s;
+        s.limit = limit_;
+        s.used  = used();
+        for (size_t i = 0; i < memory_kind_count; ++i) {
+            s.by_kind[i] = by_kind_[i].load(std::memory_order_relaxed);
+        }
+        s.evicted_bytes = evicted_.load(std::memory_order_relaxed);
+        s.rejected      = rejected_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct entry {
+        int         id;
+        int         priority;
+        std::string name;
+        evictor     fn;
+    };
+
+    static size_t idx(memory_kind k) { return static_cast<size_t>(k); }
+
+    // Atomically account `bytes` if the total stays within `cap`.
+    bool add(memory_kind k, size_t bytes, size_t cap) {
+        size_t cur = used_.load(std::memory_order_relaxed);
+        do {
+            if (cur + bytes > cap) {
+                return false;
+            }
+        } while (!used_.compare_exchange_weak(cur, cur + bytes, std::memory_order_relaxed));
+        by_kind_[idx(k)].fetch_add(bytes, std::memory_order_relaxed);
+        return true;
+    }
+
+    // One evicting thread at a time; others fall through and retry against the limit.
+    void evict(size_t bytes) {
+        if (evicting_.exchange(true, std::memory_order_acquire)) {
+            return;
+        }
+        struct done_guard {
+            std::atomic<bool> & flag;
+            ~done_guard() { flag.store(false, std::memory_order_release); }
+        } done{evicting_};
+        std::vector<entry> run;
+        {
+            std::lock_guard<std::mutex> lock(evictors_mutex_);
+            run = evictors_;
+        }
+        size_t freed = 0;
+        for (const entry & e : run) {
+            if (freed >= bytes) {
+                break;
+            }
+            freed += e.fn(bytes - freed);
+        }
+        evicted_.fetch_add(freed, std::memory_order_relaxed);
+    }
+
+    const size_t                                      limit_;
+    size_t                                            high_;
+    std::atomic<size_t>                               used_{0};
+    std::array<std::atomic<size_t>, memory_kind_count> by_kind_{};
+    std::atomic<uint64_t>                             evicted_{0};
+    std::atomic<uint64_t>                             rejected_{0};
+
+    std::mutex         evictors_mutex_; // guards the list, not the evictors' runs
+    std::vector<entry> evictors_;
+    int                next_evictor_id_ = 0;
+    std::atomic<bool>  evicting_{false};
+
+    std::mutex              wait_mutex_;
+    std::condition_variable released_;
+};
+
+// RAII ownership of bytes reserved from a governor.
+class memory_reservation {
+public:
+    memory_reservation() = default;
+
+    // Throws std::bad_alloc when the governor rejects the reservation.
+    memory_reservation(memory_governor & g, memory_kind k, size_t bytes) : gov_(&g), kind_(k) {
+        if (!g.try_reserve(k, bytes)) {
+            throw std::bad_alloc();
+        }
+        bytes_ = bytes;
+    }
+
+    static memory_reservation adopt(memory_governor & g, memory_kind k, size_t bytes) {
+        memory_reservation r;
+        r.gov_   = &g;
+        r.kind_  = k;
+        r.bytes_ = bytes;
+        return r;
+    }
+
+    memory_reservation(const memory_reservation &)             = delete;
+    memory_reservation & operator=(const memory_reservation &) = delete;
+
+    memory_reservation(memory_reservation && o) noexcept
+        : gov_(std::exchange(o.gov_, nullptr)), kind_(o.kind_), bytes_(std::exchange(o.bytes_, 0)) {}
+
+    memory_reservation & operator=(memory_reservation && o) noexcept {
+        if (this != &o) {
+            reset();
+            gov_   = std::exchange(o.gov_, nullptr);
+            kind_  = o.kind_;
+            bytes_ = std::exchange(o.bytes_, 0);
+        }
+        return *this;
+    }
+
+    ~memory_reservation() { reset(); }
+
+    size_t bytes() const { return bytes_; }
+
+    // Grow or shrink in place; returns false (unchanged) if growth is rejected.
+    bool resize(size_t bytes) {
+        if (!gov_) {
+            return bytes == 0;
+        }
+        if (bytes > bytes_) {
+            if (!gov_->try_reserve(kind_, bytes - bytes_)) {
+                return false;
+            }
+        } else {
+            gov_->release(kind_, bytes_ - bytes);
+        }
+        bytes_ = bytes;
+        return true;
+    }
+
+    void reset() {
+        if (gov_) {
+            gov_->release(kind_, bytes_);
+        }
+        bytes_ = 0;
+    }
+
+private:
+    memory_governor * gov_   = nullptr;
+    memory_kind       kind_  = memory_kind::scratch;
+    size_t            bytes_ = 0;
+};
+
+} // namespace e4b
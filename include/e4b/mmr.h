@@ -0,0 +1,92 @@
+// e4b: Embedding database in C/C++
+// Maximal marginal relevance (MMR) reranking of a candidate pool.
+//
+// Greedily picks k of the m candidates, each time the one maximising
+//   lambda * relevance - (1 - lambda) * max similarity to the picks so far
+// where relevance and similarity are both negated distances under the
+// index metric (so the two terms share a scale). lambda = 1 is plain top-k,
+// lower values trade relevance for diversity.
+//
+// Candidate vectors are gathered once into a contiguous block; after each
+// pick, one distance_block call (the SIMD kernel used by flat scans) updates
+// every remaining candidate's redundancy term, so the whole rerank costs
+// k passes over m x dim floats.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace e4b {
+
+// cands[i] is the candidate with vector vecs + i * dim. Returns the picks in
+// pick order, with their original distances.
+inline std::vector<neighbor> mmr_rerank(metric m, const neighbor * cands, const float * vecs, size_t n, size_t dim,
+                                        size_t k, float lambda) {
+    k = std::min(k, n);
+    std::vector<neighbor> out;
+    out.reserve(k);
+    if (k == 0) {
+        return out;
+    }
+    // Largest similarity (negated distance) to any pick; none yet.
+    std::vector<float> redundancy(n, -std::numeric_limits<float>::infinity());
+    std::vector<float> dist(n);
+    std::vector<char>  taken(n, 0);
+    for (size_t step = 0; step < k; ++step) {
+        size_t best       = n;
+        float  best_score = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < n; ++i) {
+            if (taken[i]) {
+                continue;
+            }
+            // Before the first pick only relevance counts.
+            const float penalty = step == 0 ? 0.0f : (1 - lambda) * redundancy[i];
+            const float score   = -lambda * cands[i].dist - penalty;
+            if (best == n || score > best_score) {
+                best       = i;
+                best_score = score;
+            }
+        }
+        taken[best] = 1;
+        out.push_back(cands[best]);
+        if (step + 1 == k) {
+            break;
+        }
+        distance_block(m, vecs + best * dim, vecs, n, dim, dist.data());
+        for (size_t i = 0; i < n; ++i) {
+            redundancy[i] = std::max(redundancy[i], -dist[i]);
+        }
+    }
+    return out;
+}
+
+// Gathers the vectors of `cands` through vec_of(id) -> const float *, then
+// reranks them.
+template <typename VecFn>
+std::vector<neighbor> mmr_rerank(metric m, const std::vector<neighbor> & cands, VecFn && vec_of, size_t dim,
+                                 size_t k, float lambda) {
+    std::vector<float> block(cands.size() * dim);
+    for (size_t i = 0; i < cands.size(); ++i) {
+        std::memcpy(block.data() + i * dim, vec_of(cands[i].id), dim * sizeof(float));
+    }
+    return mmr_rerank(m, cands.data(), block.data(), cands.size(), dim, k, lambda);
+}
+
+// Diverse search over a graph_index: fetches a pool of `pool` nearest
+// candidates, then keeps k of them by MMR.
+inline std::vector<neighbor> search_mmr(const graph_index & index, const float * q, size_t k, size_t pool, size_t ef,
+                                        float lambda, search_stats * stats = nullptr) {
+    const std::vector<neighbor> cands = index.search(q, std::max(pool, k), std::max(ef, pool), stats);
+    return mmr_rerank(
+        index.params().m, cands, [&index](idx_t id) { return index.vector(static_cast<uint32_t>(id)); }, index.dim(),
+        k, lambda);
+}
+
+} // namespace e4b
@@ -0,0 +1,362 @@
+// e4b: Embedding database in C/C++
+// All-pairs k-nearest-neighbor graph by NN-Descent.
+//
+// Starts from k random neighbors per vector and repeatedly applies "a
+// neighbor of a neighbor is likely a neighbor": in each iteration every
+// vector runs a local join over its sampled neighbor lists (forward and
+// reverse), comparing pairs of them with each other and offering each pair
+// as neighbors to both sides. Only entries that are new since the previous
+// iteration are joined against each other or against old ones, and at most
+// sample * k of each per vector, which keeps the work near O(n k^2) per
+// iteration. The loop stops once an iteration changes fewer than delta * n * k
+// entries, or after max_iters.
+//
+// Local joins run on a thread_pool; per-vector lists are guarded by striped
+// locks. The result (knn_graph) serves dedup and clustering directly, seeds a
+// graph_index through build_graph_index(), and saves as:
+//   magic "E4BKNNG1", u64 n, u32 k, u32 flags (1: distances present)
+//   u32 ids[n * k], then f32 dists[n * k] if flagged
+// Each list is ascending by distance; short lists are padded with invalid_node.
+#pragma once
+
+#include "csr_graph.h"
+#include "distance.h"
+#include "graph_index.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace e4b {
+
+struct nn_descent_params {
+    metric   m         = metric::l2;
+    size_t   k         = 20;
+    float    sample    = 0.5f;   // fraction of k new / old entries joined per vector
+    float    delta     = 0.001f; // stop when an iteration updates < delta * n * k entries
+    size_t   max_iters = 12;
+    size_t   threads   = std::thread::hardware_concurrency();
+    uint64_t seed      = 1;
+};
+
+struct nn_descent_stats {
+    size_t iterations = 0;
+    size_t distances  = 0;
+    size_t updates    = 0; // entries changed in the last iteration
+};
+
+namespace detail {
+constexpr char knn_magic[8] = {'E', '4', 'B', 'K', 'N', 'N', 'G', '1'};
+} // namespace detail
+
+class knn_graph {
+public:
+    knn_graph() = default;
+
+    knn_graph(size_t n, size_t k) :
+        n_(n),
+        k_(k),
+        ids_(n * k, invalid_node),
+        dists_(n * k, std::numeric_limits<float>::infinity()) {}
+
+    size_t size() const { return n_; }
+    size_t k() const { return k_; }
+
+    // v's neighbors, ascending by distance; degree(v) of them are valid.
+    const uint32_t * ids(uint32_t v) const { return ids_.data() + static_cast<size_t>(v) * k_; }
+    const float *    dists(uint32_t v) const { return dists_.data() + static_cast<size_t>(v) * k_; }
+    uint32_t *       ids(uint32_t v) { return ids_.data() + static_cast<size_t>(v) * k_; }
+    float *          dists(uint32_t v) { return dists_.data() + static_cast<size_t>(v) * k_; }
+
+    size_t degree(uint32_t v) const {
+        const uint32_t * l = ids(v);
+        return static_cast<size_t>(std::find(l, l + k_, invalid_node) - l);
+    }
+
+    std::vector<neighbor> neighbors(uint32_t v) const {
+        std::vector<neighbor> out;
+        for (size_t i = 0; i < degree(v); ++i) {
+            out.push_back({dists(v)[i], static_cast<idx_t>(ids(v)[i])});
+        }
+        return out;
+    }
+
+    // Written to a temporary and renamed, so a crash never leaves a torn file.
+    void save(const std::string & path, bool with_distances = true) const {
+        const std::string tmp = path + ".tmp";
+        std::FILE *       f   = std::fopen(tmp.c_str(), "wb");
+        if (!f) {
+            throw std::system_error(errno, std::generic_category(), "knn_graph: open " + tmp);
+        }
+        try {
+            uint8_t        header[24] = {};
+            const uint64_t n          = n_;
+            const uint32_t fields[2]  = {static_cast<uint32_t>(k_), with_distances ? 1u : 0u};
+            std::memcpy(header, detail::knn_magic, sizeof(detail::knn_magic));
+            std::memcpy(header + 8, &n, sizeof(n));
+            std::memcpy(header + 16, fields, sizeof(fields));
+            write(f, header, sizeof(header));
+            write(f, ids_.data(), ids_.size() * sizeof(uint32_t));
+            if (with_distances) {
+                write(f, dists_.data(), dists_.size() * sizeof(float));
+            }
+        } catch (...) {
+            std::fclose(f);
+            std::remove(tmp.c_str());
+            throw;
+        }
+        if (std::fclose(f) != 0 || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            throw std::system_error(errno, std::generic_category(), "knn_graph: save " + path);
+        }
+    }
+
+    // Distances saved without them load as infinity. The header is checked
+    // against the file size before anything is allocated, and every stored id
+    // must be a node or invalid_node.
+    static knn_graph load(const std::string & path) {
+        const mapped_file file = mapped_file::open(path);
+        const uint8_t *   p    = file.data();
+        if (file.size() < 24 || std::memcmp(p, detail::knn_magic, sizeof(detail::knn_magic)) != 0) {
+            throw std::runtime_error("knn_graph: bad magic in " + path);
+        }
+        uint64_t n;
+        uint32_t fields[2];
+        std::memcpy(&n, p + 8, sizeof(n));
+        std::memcpy(fields, p + 16, sizeof(fields));
+        const size_t entry_bytes = sizeof(uint32_t) + ((fields[1] & 1) ? sizeof(float) : 0);
+        if (n >= invalid_node || (fields[0] != 0 && n > (file.size() - 24) / entry_bytes / fields[0])) {
+            throw std::runtime_error("knn_graph: truncated " + path);
+        }
+        knn_graph    g(static_cast<size_t>(n), fields[0]);
+        const size_t id_bytes   = g.ids_.size() * sizeof(uint32_t);
+        const size_t dist_bytes = (fields[1] & 1) ? g.dists_.size() * sizeof(float) : 0;
+        std::memcpy(g.ids_.data(), p + 24, id_bytes);
+        std::memcpy(g.dists_.data(), p + 24 + id_bytes, dist_bytes);
+        for (uint32_t id : g.ids_) {
+            if (id >= n && id != invalid_node) {
+                throw std::runtime_error("knn_graph: neighbor id out of range in " + path);
+            }
+        }
+        return g;
+    }
+
+private:
+    static void write(std::FILE * f, const void * p, size_t n) {
+        if (n != 0 && std::fwrite(p, 1, n, f) != n) {
+            throw std::system_error(errno, std::generic_category(), "knn_graph: write");
+        }
+    }
+
+    size_t                n_ = 0, k_ = 0;
+    std::vector<uint32_t> ids_;
+    std::vector<float>    dists_;
+};
+
+namespace detail {
+
+// One vector's neighbor list during NN-Descent: a max-heap on distance
+// (worst entry first) with a "new since last join" flag per entry.
+struct nnd_entry {
+    float    dist;
+    uint32_t id;
+    bool     fresh;
+
+    bool operator<(const nnd_entry & o) const { return dist < o.dist; }
+};
+
+} // namespace detail
+
+// Builds the kNN graph of n vectors of x. k is clamped to n - 1.
+inline knn_graph nn_descent(const float * x, size_t n, size_t dim, nn_descent_params p = {},
+                            nn_descent_stats * stats = nullptr) {
+    check_dim(dim);
+    if (p.k == 0 || p.sample <= 0 || p.sample > 1) {
+        throw std::invalid_argument("nn_descent: k must be > 0 and sample in (0, 1]");
+    }
+    const size_t k = n > 1 ? std::min(p.k, n - 1) : 0;
+    if (k == 0) {
+        return knn_graph(n, p.k);
+    }
+    const size_t sample = std::max<size_t>(1, static_cast<size_t>(p.sample * static_cast<float>(k)));
+
+    using detail::nnd_entry;
+    std::vector<std::vector<nnd_entry>> heaps(n);
+    constexpr size_t                    n_locks = 4096;
+    std::vector<std::mutex>             locks(n_locks);
+    std::atomic<size_t>                 n_dist{0};
+    auto dist = [&](uint32_t a, uint32_t b) { return distance(p.m, x + a * dim, x + b * dim, dim); };
+
+    // Offers b to a's list; returns 1 if the list changed.
+    auto offer = [&](uint32_t a, uint32_t b, float d) -> size_t {
+        std::vector<nnd_entry> &    h = heaps[a];
+        std::lock_guard<std::mutex> lock(locks[a % n_locks]);
+        if (h.size() >= k && !(d < h.front().dist)) {
+            return 0;
+        }
+        for (const nnd_entry & e : h) {
+            if (e.id == b) {
+                return 0;
+            }
+        }
+        h.push_back({d, b, true});
+        std::push_heap(h.begin(), h.end());
+        if (h.size() > k) {
+            std::pop_heap(h.begin(), h.end());
+            h.pop_back();
+        }
+        return 1;
+    };
+
+    thread_pool  pool(std::max<size_t>(p.threads, 1));
+    const size_t n_chunks = std::min(n, pool.size() * 8);
+    // Each call (one phase of one iteration) draws fresh streams: seeding by
+    // chunk alone would replay the same samples every iteration.
+    uint64_t round   = 0;
+    auto     chunked = [&](auto && fn) {
+        ++round;
+        pool.parallel_for(n_chunks, [&](size_t c) {
+            std::seed_seq   seq{static_cast<uint32_t>(p.seed), static_cast<uint32_t>(p.seed >> 32),
+                              static_cast<uint32_t>(round), static_cast<uint32_t>(c)};
+            std::mt19937_64 rng(seq);
+            for (size_t v = n * c / n_chunks; v < n * (c + 1) / n_chunks; ++v) {
+                fn(static_cast<uint32_t>(v), rng);
+            }
+        });
+    };
+
+    chunked([&](uint32_t v, std::mt19937_64 & rng) {
+        std::uniform_int_distribution<uint32_t> pick(0, static_cast<uint32_t>(n - 1));
+        std::vector<nnd_entry> &                h = heaps[v];
+        h.reserve(k + 1);
+        while (h.size() < k) {
+            const uint32_t u = pick(rng);
+            if (u != v && std::none_of(h.begin(), h.end(), [u](const nnd_entry & e) { return e.id == u; })) {
+                h.push_back({dist(v, u), u, true});
+            }
+        }
+        std::make_heap(h.begin(), h.end());
+    });
+    n_dist += n * k;
+
+    std::vector<std::vector<uint32_t>> fresh(n), old(n), fresh_rev(n), old_rev(n);
+    size_t                             iters = 0, updates = 0;
+    const size_t                       threshold = static_cast<size_t>(p.delta * static_cast<float>(n * k));
+    while (iters < p.max_iters) {
+        ++iters;
+        // Sample up to `sample` fresh entries per list (marking them joined)
+        // and all old ones, then the reverse of both.
+        chunked([&](uint32_t v, std::mt19937_64 & rng) {
+            fresh[v].clear();
+            old[v].clear();
+            std::vector<size_t>      cand;
+            std::vector<nnd_entry> & h = heaps[v];
+            for (size_t i = 0; i < h.size(); ++i) {
+                if (h[i].fresh) {
+                    cand.push_back(i);
+                } else {
+                    old[v].push_back(h[i].id);
+                }
+            }
+            std::shuffle(cand.begin(), cand.end(), rng);
+            cand.resize(std::min(cand.size(), sample));
+            for (size_t i : cand) {
+                h[i].fresh = false;
+                fresh[v].push_back(h[i].id);
+            }
+        });
+        for (size_t v = 0; v < n; ++v) {
+            fresh_rev[v].clear();
+            old_rev[v].clear();
+        }
+        for (uint32_t v = 0; v < n; ++v) {
+            for (uint32_t u : fresh[v]) {
+                fresh_rev[u].push_back(v);
+            }
+            for (uint32_t u : old[v]) {
+                old_rev[u].push_back(v);
+            }
+        }
+        std::atomic<size_t> changed{0};
+        chunked([&](uint32_t v, std::mt19937_64 & rng) {
+            auto merge = [&](std::vector<uint32_t> & into, std::vector<uint32_t> & rev) {
+                std::shuffle(rev.begin(), rev.end(), rng);
+                rev.resize(std::min(rev.size(), sample));
+                for (uint32_t u : rev) {
+                    if (std::find(into.begin(), into.end(), u) == into.end()) {
+                        into.push_back(u);
+                    }
+                }
+            };
+            std::vector<uint32_t> nw = fresh[v], od = old[v];
+            merge(nw, fresh_rev[v]);
+            merge(od, old_rev[v]);
+            size_t local = 0, evals = 0;
+            for (size_t i = 0; i < nw.size(); ++i) {
+                for (size_t j = i + 1; j < nw.size(); ++j) {
+                    const float d = dist(nw[i], nw[j]);
+                    ++evals;
+                    local += offer(nw[i], nw[j], d) + offer(nw[j], nw[i], d);
+                }
+                for (uint32_t u : od) {
+                    if (u == nw[i]) {
+                        continue;
+                    }
+                    const float d = dist(nw[i], u);
+                    ++evals;
+                    local += offer(nw[i], u, d) + offer(u, nw[i], d);
+                }
+            }
+            changed += local;
+            n_dist += evals;
+        });
+        updates = changed.load();
+        if (updates <= threshold) {
+            break;
+        }
+    }
+
+    knn_graph out(n, p.k);
+    chunked([&](uint32_t v, std::mt19937_64 &) {
+        std::vector<nnd_entry> & h = heaps[v];
+        std::sort_heap(h.begin(), h.end());
+        for (size_t i = 0; i < h.size(); ++i) {
+            out.ids(v)[i]   = h[i].id;
+            out.dists(v)[i] = h[i].dist;
+        }
+    });
+    if (stats) {
+        stats->iterations += iters;
+        stats->distances += n_dist.load();
+        stats->updates = updates;
+    }
+    return out;
+}
+
+// graph_index over x seeded with the kNN lists as candidates, then refined
+// by `passes` search-and-relink rounds (see graph_index::build); k around
+// max_degree gives the prune rule enough to choose from.
+inline graph_index build_graph_index(const float * x, size_t dim, const knn_graph & knn, graph_params p = {},
+                                     size_t passes = 1) {
+    std::vector<std::vector<neighbor>> cands(knn.size());
+    for (uint32_t v = 0; v < knn.size(); ++v) {
+        cands[v] = knn.neighbors(v);
+    }
+    return graph_index::build(x, knn.size(), dim, cands, p, passes);
+}
+
+} // namespace e4b
@@ -0,0 +1,177 @@
+// e4b: Embedding database in C/C++
+// Compressed sorted id lists for IVF postings and sparse inverted lists.
+//
+// Ids are cut into blocks of posting_block ids; each block is delta-encoded
+// against the last id of the previous block and packed with StreamVByte, so
+// any block decodes on its own with the SIMD decoder. A skip table holding
+// the last id and byte offset of every block lets a cursor jump over whole
+// blocks when intersecting lists.
+//
+// Layout (little-endian):
+//   u32 count
+//   u32 block_count
+//   u32 data_bytes
+//   block_count x { u32 last_id, u32 offset }   offset from the start of the data
+//   data                                        StreamVByte blocks
+//
+// As with every StreamVByte buffer, readers must leave svb_padding readable
+// bytes after the encoded list.
+#pragma once
+
+#include "streamvbyte.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace e4b {
+
+constexpr size_t posting_block = 128;
+
+// `ids` must be sorted ascending. Returns the encoded list (without padding).
+inline std::vector<uint8_t> encode_posting(const uint32_t * ids, size_t n) {
+    if (n > UINT32_MAX) {
+        throw std::invalid_argument("encode_posting: list too long");
+    }
+    if (!std::is_sorted(ids, ids + n)) {
+        throw std::invalid_argument("encode_posting: ids must be sorted");
+    }
+    const size_t         blocks = (n + posting_block - 1) / posting_block;
+    const size_t         header = 12 + blocks * 8;
+    std::vector<uint8_t> out(header + svb_max_bytes(n));
+    auto                 put = [&out](size_t at, uint32_t v) { std::memcpy(out.data() + at, &v, sizeof(v)); };
+    put(0, static_cast<uint32_t>(n));
+    put(4, static_cast<uint32_t>(blocks));
+
+    size_t   pos  = 0;
+    uint32_t prev = 0;
+    for (size_t b = 0; b < blocks; ++b) {
+        const size_t begin = b * posting_block;
+        const size_t len   = std::min(posting_block, n - begin);
+        put(12 + b * 8, ids[begin + len - 1]);
+        put(12 + b * 8 + 4, static_cast<uint32_t>(pos));
+        pos += svb_encode_delta(ids + begin, len, out.data() + header + pos, prev);
+        prev = ids[begin + len - 1];
+    }
+    put(8, static_cast<uint32_t>(pos));
+    out.resize(header + pos);
+    return out;
+}
+
+inline std::vector<uint8_t> encode_posting(const std::vector<uint32_t> & ids) {
+    return encode_posting(ids.data(), ids.size());
+}
+
+// Non-owning view over an encoded list.
+class posting_view {
+public:
+    posting_view() = default;
+
+    explicit posting_view(const uint8_t * data) : data_(data) {
+        count_  = get(0);
+        blocks_ = get(4);
+    }
+
+    size_t size() const { return count_; }
+    size_t block_count() const { return blocks_; }
+
+    // Total encoded size, i.e. where the next record starts.
+    size_t encoded_bytes() const { return 12 + blocks_ * 8 + get(8); }
+
+    uint32_t block_last(size_t b) const { return get(12 + b * 8); }
+    size_t   block_size(size_t b) const { return b + 1 < blocks_ ? posting_block : count_ - b * posting_block; }
+
+    // Decodes block b into out (at least posting_block entries); returns its size.
+    size_t decode_block(size_t b, uint32_t * out) const {
+        const uint32_t prev = b == 0 ? 0 : block_last(b - 1);
+        const size_t   len  = block_size(b);
+        svb_decode_delta(data_ + 12 + blocks_ * 8 + block_offset(b), len, out, prev);
+        return len;
+    }
+
+    void decode(uint32_t * out) const {
+        for (size_t b = 0; b < blocks_; ++b) {
+            decode_block(b, out + b * posting_block);
+        }
+    }
+
+    std::vector<uint32_t> decode() const {
+        std::vector<uint32_t> out(count_);
+        decode(out.data());
+        return out;
+    }
+
+    // First block whose last id is >= target (block_count() if none).
+    size_t find_block(uint32_t target, size_t from = 0) const {
+        size_t lo = from, hi = blocks_;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (block_last(mid) < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+private:
+    uint32_t get(size_t at) const {
+        uint32_t v;
+        std::memcpy(&v, data_ + at, sizeof(v));
+        return v;
+    }
+
+    size_t block_offset(size_t b) const { return get(12 + b * 8 + 4); }
+
+    const uint8_t * data_   = nullptr;
+    size_t          count_  = 0;
+    size_t          blocks_ = 0;
+};
+
+// Forward iterator with block-skipping seek, for list intersection.
+class posting_cursor {
+public:
+    explicit posting_cursor(const posting_view & v) : view_(v) { load(0); }
+
+    bool     valid() const { return block_ < view_.block_count(); }
+    uint32_t value() const { return buf_[pos_]; }
+
+    void next() {
+        if (++pos_ >= len_) {
+            load(block_ + 1);
+        }
+    }
+
+    // Advances to the first id >= target; never moves backwards.
+    void skip_to(uint32_t target) {
+        if (!valid() || value() >= target) {
+            return;
+        }
+        if (view_.block_last(block_) < target) {
+            load(view_.find_block(target, block_ + 1));
+            if (!valid()) {
+                return;
+            }
+        }
+        pos_ = static_cast<size_t>(std::lower_bound(buf_ + pos_, buf_ + len_, target) - buf_);
+    }
+
+private:
+    void load(size_t b) {
+        block_ = b;
+        pos_   = 0;
+        len_   = valid() ? view_.decode_block(b, buf_) : 0;
+    }
+
+    posting_view view_;
+    size_t       block_ = 0;
+    size_t       pos_   = 0;
+    size_t       len_   = 0;
+    uint32_t     buf_[posting_block];
+};
+
+} // namespace e4b
@@ -0,0 +1,241 @@
+// e4b: Embedding database in C/C++
+// Numeric range filters combined with vector search.
+//
+// sorted_column keeps one numeric attribute sorted with its row positions, so
+// the rows with a value in [lo, hi] form one contiguous slice found by two
+// binary searches.
+//
+// range_partitioned_index stores the vectors in attribute order and builds a
+// segment tree over that order: every node covering more than
+// flat_threshold rows gets its own graph_index, smaller nodes are leaves.
+// A query "nearest with value in [lo, hi]" decomposes the matching slice
+// into O(log n) canonical nodes; fully covered nodes are searched through
+// their graph, and the ragged edges and leaves are scanned flat. No visited
+// node contains a row outside the range, so selectivity never hurts recall.
+//
+// Each tree level holds a graph over every row, so the sub-indexes cost
+// about log2(n / flat_threshold) times the memory of one graph. With
+// range_index_params::sub_indexes off only the root is indexed: a range is
+// then a slice of its nodes, answered by a filtered search of the root
+// graph, or scanned flat when it holds at most flat_threshold rows.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "thread_pool.h"
+#include "topk.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+class sorted_column {
+public:
+    sorted_column() = default;
+
+    static sorted_column build(const double * values, size_t n) {
+        sorted_column c;
+        c.rows_.resize(n);
+        std::iota(c.rows_.begin(), c.rows_.end(), 0u);
+        std::stable_sort(c.rows_.begin(), c.rows_.end(),
+                         [values](uint32_t a, uint32_t b) { return values[a] < values[b]; });
+        c.values_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            c.values_[i] = values[c.rows_[i]];
+        }
+        return c;
+    }
+
+    size_t size() const { return values_.size(); }
+
+    // Sorted positions [first, second) of the values in [lo, hi].
+    std::pair<size_t, size_t> slice(double lo, double hi) const {
+        if (!(lo <= hi)) {
+            return {0, 0};
+        }
+        const size_t b = static_cast<size_t>(std::lower_bound(values_.begin(), values_.end(), lo) - values_.begin());
+        const size_t e = static_cast<size_t>(std::upper_bound(values_.begin(), values_.end(), hi) - values_.begin());
+        return {b, e};
+    }
+
+    size_t count(double lo, double hi) const {
+        const auto s = slice(lo, hi);
+        return s.second - s.first;
+    }
+
+    double   value(size_t pos) const { return values_[pos]; } // pos-th smallest value
+    uint32_t row(size_t pos) const { return rows_[pos]; }     // its input row
+
+    size_t memory_bytes() const { return values_.capacity() * sizeof(double) + rows_.capacity() * sizeof(uint32_t); }
+
+private:
+    std::vector<double>   values_;
+    std::vector<uint32_t> rows_;
+};
+
+struct range_index_params {
+    size_t       flat_threshold = 2048; // nodes up to this size are scanned flat
+    graph_params graph;                 // graph_params::m is also the flat scan metric
+    size_t       ef = 64;               // graph search beam width
+    size_t       build_threads = std::thread::hardware_concurrency();
+    bool         sub_indexes   = true; // false: one graph over all rows
+};
+
+struct range_search_stats {
+    size_t       graphs_searched = 0; // canonical nodes answered by their graph
+    size_t       flat_scanned    = 0; // vectors scanned flat
+    search_stats graph;               // summed over the graph searches
+};
+
+class range_partitioned_index {
+public:
+    // x holds n vectors of dim floats, values their attribute and ids their
+    // external ids.
+    static range_partitioned_index build(const float * x, const idx_t * ids, const double * values, size_t n,
+                                         size_t dim, range_index_params p = {}) {
+        check_dim(dim);
+        if (p.flat_threshold == 0) {
+            throw std::invalid_argument("range_partitioned_index: flat_threshold must be > 0");
+        }
+        range_partitioned_index idx;
+        idx.dim_    = dim;
+        idx.params_ = p;
+        idx.column_ = sorted_column::build(values, n);
+        idx.data_.resize(n * dim);
+        idx.ids_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t r = idx.column_.row(i);
+            std::copy(x + static_cast<size_t>(r) * dim, x + static_cast<size_t>(r + 1) * dim, idx.data_.data() + i * dim);
+            idx.ids_[i] = ids[r];
+        }
+        if (n > 0 && p.sub_indexes) {
+            idx.build_node(0, n);
+        } else if (n > 0) {
+            idx.nodes_.push_back({0, n, 0, 0, nullptr});
+        }
+        // Node graphs are independent: build them in parallel.
+        thread_pool pool(p.build_threads);
+        pool.parallel_for(idx.nodes_.size(), [&idx](size_t i) {
+            node & nd = idx.nodes_[i];
+            if (nd.end - nd.begin > idx.params_.flat_threshold) {
+                nd.graph = std::make_unique<graph_index>(idx.dim_, idx.params_.graph);
+                nd.graph->add(idx.data_.data() + nd.begin * idx.dim_, nd.end - nd.begin);
+            }
+        });
+        return idx;
+    }
+
+    size_t                size() const { return ids_.size(); }
+    size_t                dim() const { return dim_; }
+    const sorted_column & column() const { return column_; }
+
+    // k nearest among the vectors whose value is in [lo, hi].
+    std::vector<neighbor> search(const float * q, double lo, double hi, size_t k,
+                                 range_search_stats * stats = nullptr) const {
+        if (k == 0) {
+            return {};
+        }
+        topk_collector top(k);
+        const auto     s = column_.slice(lo, hi);
+        if (s.first < s.second) {
+            range_search_stats local;
+            std::vector<float> dist;
+            visit(0, s.first, s.second, q, k, top, dist, local);
+            if (stats) {
+                stats->graphs_searched += local.graphs_searched;
+                stats->flat_scanned += local.flat_scanned;
+                stats->graph.hops += local.graph.hops;
+                stats->graph.distances += local.graph.distances;
+            }
+        }
+        return top.results();
+    }
+
+    size_t memory_bytes() const {
+        size_t bytes = data_.capacity() * sizeof(float) + ids_.capacity() * sizeof(idx_t) + column_.memory_bytes() +
+                       nodes_.capacity() * sizeof(node);
+        for (const node & nd : nodes_) {
+            bytes += nd.graph ? nd.graph->memory_bytes() : 0;
+        }
+        return bytes;
+    }
+
+private:
+    range_partitioned_index() = default;
+
+    // Node covering sorted positions [begin, end). Graph node i is begin + i.
+    // Nodes over flat_threshold rows have a graph; without sub_indexes the
+    // root is the only node.
+    struct node {
+        size_t                       begin = 0, end = 0;
+        size_t                       left = 0, right = 0; // children; 0 for leaves (the root is never a child)
+        std::unique_ptr<graph_index> graph;
+    };
+
+    size_t build_node(size_t begin, size_t end) {
+        const size_t at = nodes_.size();
+        nodes_.push_back({begin, end, 0, 0, nullptr});
+        if (end - begin <= params_.flat_threshold) {
+            return at;
+        }
+        const size_t mid = begin + (end - begin) / 2;
+        const size_t l   = build_node(begin, mid);
+        const size_t r   = build_node(mid, end);
+        nodes_[at].left  = l;
+        nodes_[at].right = r;
+        return at;
+    }
+
+    void visit(size_t at, size_t lo, size_t hi, const float * q, size_t k, topk_collector & top,
+               std::vector<float> & dist, range_search_stats & st) const {
+        const node & nd = nodes_[at];
+        const size_t b  = std::max(nd.begin, lo);
+        const size_t e  = std::min(nd.end, hi);
+        if (b >= e) {
+            return;
+        }
+        if (nd.graph && b == nd.begin && e == nd.end) {
+            for (const neighbor & r : nd.graph->search(q, k, params_.ef, &st.graph)) {
+                top.push(r.dist, ids_[nd.begin + static_cast<size_t>(r.id)]);
+            }
+            ++st.graphs_searched;
+            return;
+        }
+        if (nd.graph && nd.left == 0 && e - b > params_.flat_threshold) {
+            // Indexed node without children: the range is a slice of its graph.
+            auto in_range = [&nd, b, e](uint32_t v) { return nd.begin + v >= b && nd.begin + v < e; };
+            for (const neighbor & r : nd.graph->search_filtered(q, k, params_.ef, in_range, &st.graph)) {
+                top.push(r.dist, ids_[nd.begin + static_cast<size_t>(r.id)]);
+            }
+            ++st.graphs_searched;
+            return;
+        }
+        if (!nd.graph || nd.left == 0) {
+            dist.resize(e - b);
+            distance_block(params_.graph.m, q, data_.data() + b * dim_, e - b, dim_, dist.data());
+            top.push_block(dist.data(), ids_.data() + b, e - b);
+            st.flat_scanned += e - b;
+            return;
+        }
+        visit(nd.left, lo, hi, q, k, top, dist, st);
+        visit(nd.right, lo, hi, q, k, top, dist, st);
+    }
+
+    size_t             dim_ = 0;
+    range_index_params params_;
+    sorted_column      column_;
+    std::vector<float> data_; // in attribute order
+    std::vector<idx_t> ids_;  // in attribute order
+    std::vector<node>  nodes_;
+};
+
+} // namespace e4b
@@ -0,0 +1,166 @@
+// e4b: Embedding database in C/C++
+// Range (radius) search: every vector within distance r of the query.
+//
+// Results are unbounded, so they stream out in chunks: a range_buffer hands
+// every chunk_size hits to `sink(const neighbor * hits, size_t n)` and reuses
+// its storage, which keeps memory flat in dense regions. Hits come in scan
+// order, not sorted. A sink returning false stops the search early.
+//
+//   range_search_flat   blocked distance_block scan
+//   graph_range_search  beam search to reach the ball, then an expanding
+//                       frontier over every node found inside it
+//   spann_index::range_search (spann.h) prunes posting lists by the
+//                       triangle-inequality bound against r
+//
+// Distances are in the metric's units: squared L2, or negated inner product.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "graph_search.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace e4b {
+
+template <typename Sink>
+class range_buffer {
+public:
+    range_buffer(Sink & sink, size_t chunk_size = 1024) : sink_(sink), chunk_(std::max<size_t>(chunk_size, 1)) {
+        buf_.reserve(chunk_);
+    }
+
+    range_buffer(const range_buffer &)             = delete;
+    range_buffer & operator=(const range_buffer &) = delete;
+
+    // False once the sink asked to stop.
+    bool push(float dist, idx_t id) {
+        if (stopped_) {
+            return false;
+        }
+        buf_.push_back({dist, id});
+        ++total_;
+        if (buf_.size() >= chunk_) {
+            flush();
+        }
+        return !stopped_;
+    }
+
+    void flush() {
+        if (!buf_.empty() && !stopped_) {
+            stopped_ = !sink_(buf_.data(), buf_.size());
+        }
+        buf_.clear();
+    }
+
+    bool   stopped() const { return stopped_; }
+    size_t total() const { return total_; } // hits pushed so far
+
+private:
+    Sink &                sink_;
+    size_t                chunk_;
+    std::vector<neighbor> buf_;
+    size_t                total_   = 0;
+    bool                  stopped_ = false;
+};
+
+// Scans n vectors (ids first_id, first_id + 1, ...) and streams those within
+// radius; returns the number of hits.
+template <typename Sink>
+size_t range_search_flat(metric m, const float * q, const float * x, size_t n, size_t dim, float radius, Sink && sink,
+                         idx_t first_id = 0, size_t chunk_size = 1024) {
+    constexpr size_t   block = 4096;
+    range_buffer<Sink> out(sink, chunk_size);
+    std::vector<float> dist(std::min(n, block));
+    for (size_t b = 0; b < n && !out.stopped(); b += block) {
+        const size_t len = std::min(block, n - b);
+        distance_block(m, q, x + b * dim, len, dim, dist.data());
+        for (size_t i = 0; i < len; ++i) {
+            if (dist[i] <= radius && !out.push(dist[i], first_id + static_cast<idx_t>(b + i))) {
+                break;
+            }
+        }
+    }
+    out.flush();
+    return out.total();
+}
+
+// Graph range search. A beam search of width ef finds the region closest to
+// q; from every node inside the ball, neighbors are then explored breadth
+// first, and those within radius * (1 + slack) keep the frontier growing
+// (slack > 0 bridges small gaps between parts of the ball). Only nodes within
+// radius are emitted. Unlike the emitted hits, the frontier is not chunked:
+// it can hold every node found inside the ball at once, so its memory grows
+// with the result size (visited marks are O(n) regardless). Returns the
+// number of hits.
+template <typename Graph, typename DistFn, typename Sink>
+size_t graph_range_search(const Graph & g, DistFn && dist, const uint32_t * entries, size_t n_entries, float radius,
+                          size_t ef, visited_list & visited, Sink && sink, float slack = 0.0f,
+                          size_t chunk_size = 1024, search_stats * stats = nullptr) {
+    range_buffer<Sink>   out(sink, chunk_size);
+    search_stats         local;
+    const float          reach = radius >= 0 ? radius * (1 + slack) : radius / (1 + slack);
+    std::deque<uint32_t> frontier;
+    for (const neighbor & c : beam_search(g, dist, entries, n_entries, ef, visited, &local)) {
+        if (c.dist <= radius) {
+            out.push(c.dist, c.id);
+        }
+        if (c.dist <= reach) {
+            frontier.push_back(static_cast<uint32_t>(c.id));
+        }
+    }
+    // The beam already visited nodes it did not keep; they must not block
+    // the expansion, so expansion uses its own marks.
+    visited.reset(g.size());
+    for (uint32_t v : frontier) {
+        visited.visit(v);
+    }
+
+    std::vector<uint32_t> nbrs(g.max_degree());
+    while (!frontier.empty() && !out.stopped()) {
+        const uint32_t u = frontier.front();
+        frontier.pop_front();
+        ++local.hops;
+        const size_t deg = g.neighbors(u, nbrs.data());
+        for (size_t i = 0; i < deg; ++i) {
+            const uint32_t v = nbrs[i];
+            if (!visited.visit(v)) {
+                continue;
+            }
+            const float d = dist(v);
+            ++local.distances;
+            if (d <= radius && !out.push(d, static_cast<idx_t>(v))) {
+                break;
+            }
+            if (d <= reach) {
+                frontier.push_back(v);
+            }
+        }
+    }
+    out.flush();
+    if (stats) {
+        stats->hops += local.hops;
+        stats->distances += local.distances;
+    }
+    return out.total();
+}
+
+// Range search over a graph_index; hit ids are node ids.
+template <typename Sink>
+size_t range_search(const graph_index & index, const float * q, float radius, size_t ef, Sink && sink,
+                    float slack = 0.0f, size_t chunk_size = 1024, search_stats * stats = nullptr) {
+    if (index.size() == 0) {
+        return 0;
+    }
+    const uint32_t entry   = index.entry();
+    visited_list & visited = thread_visited(index.size());
+    return graph_range_search(index.graph(), index.dist_to(q), &entry, 1, radius, ef, visited, sink, slack, chunk_size,
+                              stats);
+}
+
+} // namespace e4b
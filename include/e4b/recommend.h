@@ -0,0 +1,191 @@
+// e4b: Embedding database in C/C++
+// Search by stored ids: "more like these, less like those".
+//
+// A recommend_query lists positive and negative example ids with weights.
+// Their vectors are fetched from the index itself through a vector_cache,
+// which a batch of queries shares so repeated examples are copied once.
+// Two strategies:
+//   average     search once with mean(pos) + (mean(pos) - mean(neg)), the
+//               weighted means of the examples; as fast as a plain search.
+//   best_score  score every candidate against each example: the distance to
+//               the closest positive, and candidates closer to a negative
+//               than to any positive are pushed back by twice the margin. A
+//               heavier example pulls harder: its distances are divided by
+//               the weight when non-negative and multiplied when negative
+//               (inner product). Costs one distance per example per visit.
+// Weights must be positive.
+// Example ids are never returned.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "graph_search.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+struct weighted_id {
+    idx_t id     = -1;
+    float weight = 1;
+};
+
+enum class recommend_strategy { average, best_score };
+
+struct recommend_query {
+    std::vector<weighted_id> positive;
+    std::vector<weighted_id> negative;
+    recommend_strategy       strategy = recommend_strategy::average;
+};
+
+// Copies of stored vectors keyed by id; fetch(id) -> const float * reads the
+// index. Meant to live for one batch.
+template <typename FetchFn>
+class vector_cache {
+public:
+    vector_cache(size_t dim, FetchFn fetch) : dim_(dim), fetch_(std::move(fetch)) {}
+
+    // The pointer stays valid for the cache's lifetime.
+    const float * get(idx_t id) {
+        auto it = vecs_.find(id);
+        if (it != vecs_.end()) {
+            ++hits_;
+            return it->second.data();
+        }
+        ++misses_;
+        const float * v = fetch_(id);
+        return vecs_.emplace(id, std::vector<float>(v, v + dim_)).first->second.data();
+    }
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    size_t                                        dim_;
+    FetchFn                                       fetch_;
+    std::unordered_map<idx_t, std::vector<float>> vecs_; // node-based: copies never move
+    size_t                                        hits_ = 0, misses_ = 0;
+};
+
+// Weighted mean(pos) + (mean(pos) - mean(neg)); without negatives, mean(pos).
+template <typename Cache>
+std::vector<float> average_query(const recommend_query & rq, Cache & cache, size_t dim) {
+    auto mean = [&](const std::vector<weighted_id> & ex) {
+        std::vector<float> m(dim, 0.0f);
+        float              total = 0;
+        for (const weighted_id & e : ex) {
+            const float * v = cache.get(e.id);
+            for (size_t j = 0; j < dim; ++j) {
+                m[j] += e.weight * v[j];
+            }
+            total += e.weight;
+        }
+        for (float & x : m) {
+            x = total > 0 ? x / total : 0.0f;
+        }
+        return m;
+    };
+    std::vector<float> q = mean(rq.positive);
+    if (!rq.negative.empty()) {
+        const std::vector<float> neg = mean(rq.negative);
+        for (size_t j = 0; j < dim; ++j) {
+            q[j] += q[j] - neg[j];
+        }
+    }
+    return q;
+}
+
+// Recommendation over a graph_index whose node ids are the stored ids.
+template <typename Cache>
+std::vector<neighbor> recommend(const graph_index & index, const recommend_query & rq, size_t k, size_t ef,
+                                Cache & cache, search_stats * stats = nullptr) {
+    if (rq.positive.empty()) {
+        throw std::invalid_argument("recommend: at least one positive example is required");
+    }
+    auto positive = [](const weighted_id & e) { return e.weight > 0; };
+    if (!std::all_of(rq.positive.begin(), rq.positive.end(), positive) ||
+        !std::all_of(rq.negative.begin(), rq.negative.end(), positive)) {
+        throw std::invalid_argument("recommend: example weights must be > 0");
+    }
+    const size_t dim     = index.dim();
+    const size_t n_ex    = rq.positive.size() + rq.negative.size();
+    const size_t fetch_k = k + n_ex; // room to drop the examples themselves
+    std::vector<neighbor> res;
+    if (rq.strategy == recommend_strategy::average) {
+        const std::vector<float> q = average_query(rq, cache, dim);
+        res                        = index.search(q.data(), fetch_k, std::max(ef, fetch_k), stats);
+    } else {
+        std::vector<const float *> pos, neg;
+        for (const weighted_id & e : rq.positive) {
+            pos.push_back(cache.get(e.id));
+        }
+        for (const weighted_id & e : rq.negative) {
+            neg.push_back(cache.get(e.id));
+        }
+        const metric m        = index.params().m;
+        auto         weighted = [](float d, float w) { return d >= 0 ? d / w : d * w; };
+        auto         score    = [&](uint32_t v) {
+            const float * x     = index.vector(v);
+            float         d_pos = std::numeric_limits<float>::infinity();
+            float         d_neg = std::numeric_limits<float>::infinity();
+            for (size_t i = 0; i < pos.size(); ++i) {
+                d_pos = std::min(d_pos, weighted(distance(m, x, pos[i], dim), rq.positive[i].weight));
+            }
+            for (size_t i = 0; i < neg.size(); ++i) {
+                d_neg = std::min(d_neg, weighted(distance(m, x, neg[i], dim), rq.negative[i].weight));
+            }
+            return d_pos <= d_neg ? d_pos : d_pos + 2 * (d_pos - d_neg);
+        };
+        // Start from the positives: the best candidates are around them.
+        std::vector<uint32_t> entries;
+        for (const weighted_id & e : rq.positive) {
+            if (e.id >= 0 && static_cast<size_t>(e.id) < index.size()) {
+                entries.push_back(static_cast<uint32_t>(e.id));
+            }
+        }
+        entries.push_back(index.entry());
+        visited_list & visited = thread_visited(index.size());
+        res = beam_search(index.graph(), score, entries.data(), entries.size(), std::max(ef, fetch_k), visited, stats);
+    }
+
+    std::vector<neighbor> out;
+    for (const neighbor & r : res) {
+        auto is_example = [&](const weighted_id & e) { return e.id == r.id; };
+        if (std::none_of(rq.positive.begin(), rq.positive.end(), is_example) &&
+            std::none_of(rq.negative.begin(), rq.negative.end(), is_example)) {
+            out.push_back(r);
+            if (out.size() == k) {
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+// Runs a batch of recommendations over one shared vector cache.
+inline std::vector<std::vector<neighbor>> recommend_batch(const graph_index & index,
+                                                          const std::vector<recommend_query> & queries, size_t k,
+                                                          size_t ef, search_stats * stats = nullptr) {
+    auto fetch = [&index](idx_t id) {
+        if (id < 0 || static_cast<size_t>(id) >= index.size()) {
+            throw std::out_of_range("recommend: unknown id");
+        }
+        return index.vector(static_cast<uint32_t>(id));
+    };
+    vector_cache<decltype(fetch)>      cache(index.dim(), fetch);
+    std::vector<std::vector<neighbor>> out;
+    out.reserve(queries.size());
+    for (const recommend_query & rq : queries) {
+        out.push_back(recommend(index, rq, k, ef, cache, stats));
+    }
+    return out;
+}
+
+} // namespace e4b
@@ -0,0 +1,365 @@
+// e4b: Embedding database in C/C++
+// Sharing sealed segments between the processes of one host.
+//
+// Sealed segment files are mapped read-only with MAP_SHARED (mapped_file), so
+// every worker process reads the same page-cache pages; so are the segments'
+// saved id maps (id_map::map). Mutable per-segment state such as delete
+// bitmaps lives in POSIX shared memory (shared_region) and is updated with
+// atomics, so N readers cost the memory of one.
+//
+// A single writer process publishes the set of live segments as a manifest
+// file, written to a temporary, fsynced and replaced atomically by rename.
+// Readers poll it with a shared_reader, which maps new segments, drops retired
+// ones and swaps the set in through an index_handle so queries never see a
+// half-updated view.
+#pragma once
+
+#include "id_map.h"
+#include "index_handle.h"
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+// Named POSIX shared memory mapping.
+class shared_region {
+public:
+    shared_region() = default;
+
+    // Creates (or reuses) `name` and sizes it to `bytes`. New memory is zeroed.
+    static shared_region create(const std::string & name, size_t bytes) {
+        const int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shared_region: shm_open " + name);
+        }
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            const int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "shared_region: ftruncate " + name);
+        }
+        return map(fd, name, bytes);
+    }
+
+    // Maps an existing region created by another process.
+    static shared_region open(const std::string & name) {
+        const int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shared_region: shm_open " + name);
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "shared_region: stat " + name);
+        }
+        return map(fd, name, static_cast<size_t>(st.st_size));
+    }
+
+    // Removes the name; existing mappings stay valid until unmapped.
+    static void unlink(const std::string & name) { ::shm_unlink(name.c_str()); }
+
+    shared_region(const shared_region &)             = delete;
+    shared_region & operator=(const shared_region &) = delete;
+
+    shared_region(shared_region && o) noexcept { swap(o); }
+
+    shared_region & operator=(shared_region && o) noexcept {
+        if (this != &o) {
+            close();
+            swap(o);
+        }
+        return *this;
+    }
+
+    ~shared_region() { close(); }
+
+    uint8_t *           data() const { return data_; }
+    size_t              size() const { return size_; }
+    const std::string & name() const { return name_; }
+
+    void close() {
+        if (data_) {
+            ::munmap(data_, size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        name_.clear();
+    }
+
+private:
+    static shared_region map(int fd, const std::string & name, size_t bytes) {
+        shared_region r;
+        if (bytes > 0) {
+            void * p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                const int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "shared_region: mmap " + name);
+            }
+            r.data_ = static_cast<uint8_t *>(p);
+        }
+        ::close(fd);
+        r.size_ = bytes;
+        r.name_ = name;
+        return r;
+    }
+
+    void swap(shared_region & o) noexcept {
+        std::swap(data_, o.data_);
+        std::swap(size_, o.size_);
+        std::swap(name_, o.name_);
+    }
+
+    uint8_t *   data_ = nullptr;
+    size_t      size_ = 0;
+    std::string name_;
+};
+
+// Delete bitmap stored in a shared_region. Bits are set with atomic OR, so the
+// writer can tombstone rows while readers test them from other processes.
+class shared_bitset {
+public:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared_bitset needs lock-free 64-bit atomics");
+
+    static size_t bytes_for(size_t bits) { return (bits + 63) / 64 * sizeof(uint64_t); }
+
+    shared_bitset() = default;
+
+    explicit shared_bitset(shared_region region) : region_(std::move(region)) {}
+
+    size_t size() const { return region_.size() / sizeof(uint64_t) * 64; }
+
+    bool test(size_t i) const {
+        return i < size() && (word(i).load(std::memory_order_acquire) >> (i % 64) & 1) != 0;
+    }
+
+    void set(size_t i) {
+        if (i >= size()) {
+            throw std::out_of_range("shared_bitset: bit out of range");
+        }
+        word(i).fetch_or(uint64_t{1} << (i % 64), std::memory_order_release);
+    }
+
+    const shared_region & region() const { return region_; }
+
+private:
+    std::atomic<uint64_t> & word(size_t i) const {
+        return reinterpret_cast<std::atomic<uint64_t> *>(region_.data())[i / 64];
+    }
+
+    shared_region region_;
+};
+
+struct manifest_segment {
+    uint64_t    id = 0;
+    std::string path;    // sealed segment file
+    std::string deletes; // shared_region name of its delete bitmap, empty if none
+    std::string ids;     // saved id_map of the segment, empty if none
+};
+
+struct manifest {
+    uint64_t                      version = 0;
+    std::vector<manifest_segment> segments;
+};
+
+// Text format, one record per line:
+//   e4b-manifest 2
+//   version <n>
+//   segment <id> <len>:<path> <len>:<deletes> <len>:<ids>
+// Strings are length-prefixed, so any byte but NUL may appear in them
+// (spaces, newlines); an empty field has length 0. Version 1 manifests
+// (whitespace-separated path and deletes, "-" for none) are still read.
+inline void write_manifest(const std::string & path, const manifest & m) {
+    std::ostringstream out;
+    out << "e4b-manifest 2\nversion " << m.version << '\n';
+    for (const manifest_segment & s : m.segments) {
+        if (s.path.empty()) {
+            throw std::invalid_argument("manifest: segment " + std::to_string(s.id) + " has no path");
+        }
+        out << "segment " << s.id;
+        for (const std::string * f : {&s.path, &s.deletes, &s.ids}) {
+            if (f->find('\0') != std::string::npos) {
+                throw std::invalid_argument("manifest: NUL in a name of segment " + std::to_string(s.id));
+            }
+            out << ' ' << f->size() << ':' << *f;
+        }
+        out << '\n';
+    }
+    const std::string text = out.str();
+
+    const std::string tmp = path + ".tmp";
+    const int         fd  = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "manifest: open " + tmp);
+    }
+    for (size_t done = 0; done < text.size();) {
+        const ssize_t n = ::write(fd, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            const int err = n < 0 ? errno : EIO;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "manifest: write " + tmp);
+        }
+        done += static_cast<size_t>(n);
+    }
+    // The contents must be durable before the rename makes them visible.
+    if (::fsync(fd) != 0) {
+        const int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "manifest: fsync " + tmp);
+    }
+    ::close(fd);
+    // Readers either see the previous manifest or this one, never a partial file.
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::system_error(errno, std::generic_category(), "manifest: rename " + tmp);
+    }
+    // Persist the rename itself.
+    const size_t      slash = path.rfind('/');
+    const std::string dir   = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int         dfd   = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+namespace detail {
+
+// Reads one "<len>:<bytes>" field.
+inline bool read_manifest_field(std::istream & in, std::string & out) {
+    size_t len = 0;
+    char   colon = 0;
+    if (!(in >> len) || !in.get(colon) || colon != ':') {
+        return false;
+    }
+    out.resize(len);
+    return len == 0 || static_cast<bool>(in.read(&out[0], static_cast<std::streamsize>(len)));
+}
+
+} // namespace detail
+
+inline manifest read_manifest(const std::string & path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::system_error(errno, std::generic_category(), "manifest: open " + path);
+    }
+    manifest    m;
+    std::string line;
+    if (!std::getline(in, line) || (line != "e4b-manifest 1" && line != "e4b-manifest 2")) {
+        throw std::runtime_error("manifest: bad header in " + path);
+    }
+    const bool  v1 = line == "e4b-manifest 1";
+    std::string tag;
+    while (in >> tag) {
+        bool ok = true;
+        if (tag == "version") {
+            ok = static_cast<bool>(in >> m.version);
+        } else if (tag == "segment") {
+            manifest_segment s;
+            if (v1) {
+                ok = static_cast<bool>(in >> s.id >> s.path >> s.deletes);
+                if (s.deletes == "-") {
+                    s.deletes.clear();
+                }
+            } else {
+                ok = in >> s.id && detail::read_manifest_field(in, s.path) &&
+                     detail::read_manifest_field(in, s.deletes) && detail::read_manifest_field(in, s.ids);
+            }
+            m.segments.push_back(std::move(s));
+        } else {
+            throw std::runtime_error("manifest: unknown record '" + tag + "' in " + path);
+        }
+        if (!ok) {
+            throw std::runtime_error("manifest: malformed record in " + path);
+        }
+    }
+    return m;
+}
+
+// One mapped segment as seen by a reader process.
+struct shared_segment {
+    uint64_t      id = 0;
+    mapped_file   data;
+    shared_bitset deletes;
+    id_map        ids; // read-only mapping; empty if the manifest names none
+};
+
+struct shared_segment_set {
+    uint64_t                                     version = 0;
+    std::vector<std::shared_ptr<shared_segment>> segments;
+};
+
+// Reader side: poll() the manifest and swap in new segment sets.
+class shared_reader {
+public:
+    explicit shared_reader(std::string manifest_path)
+        : path_(std::move(manifest_path)), current_(std::make_shared<const shared_segment_set>()) {}
+
+    std::shared_ptr<const shared_segment_set> acquire() const { return current_.acquire(); }
+
+    // Returns true if a newer manifest was found and published. Segments
+    // present in both versions are reused, not remapped.
+    bool poll() {
+        if (::access(path_.c_str(), F_OK) != 0) {
+            return false;
+        }
+        const manifest m = read_manifest(path_);
+
+        std::shared_ptr<const shared_segment_set> cur = current_.acquire();
+        if (m.version <= cur->version) {
+            return false;
+        }
+        std::map<uint64_t, std::shared_ptr<shared_segment>> old;
+        for (const auto & s : cur->segments) {
+            old.emplace(s->id, s);
+        }
+        auto next     = std::make_shared<shared_segment_set>();
+        next->version = m.version;
+        for (const manifest_segment & ms : m.segments) {
+            auto it = old.find(ms.id);
+            if (it != old.end()) {
+                next->segments.push_back(it->second);
+                continue;
+            }
+            auto s  = std::make_shared<shared_segment>();
+            s->id   = ms.id;
+            s->data = mapped_file::open(ms.path);
+            if (!ms.deletes.empty()) {
+                s->deletes = shared_bitset(shared_region::open(ms.deletes));
+            }
+            if (!ms.ids.empty()) {
+                s->ids = id_map::map(ms.ids);
+            }
+            next->segments.push_back(std::move(s));
+        }
+        current_.publish(std::move(next));
+        return true;
+    }
+
+private:
+    std::string                      path_;
+    index_handle<shared_segment_set> current_;
+};
+
+} // namespace e4b
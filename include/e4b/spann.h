@@ -0,0 +1,540 @@
+// e4b: Embedding database in C/C++
+// SPANN-style disk-resident IVF index.
+//
+// Only the centroids live in memory, indexed by a proximity graph; the
+// posting lists (compressed ids and full vectors) live in one file on SSD.
+//
+// Build:
+//   - hierarchical balanced k-means cuts the collection into clusters of at
+//     most max_posting vectors;
+//   - each vector is written to its closest posting and replicated into the
+//     postings (up to `replicas` in total) whose centroid is within
+//     (1 + replica_eps) of the closest one. An RNG rule skips centroids that
+//     lie in the same direction as one already chosen, so the copies cover
+//     different boundaries.
+// Search:
+//   - the centroid graph yields the closest max_probes centroids;
+//   - probes farther than (1 + eps) times the closest are pruned, with eps
+//     fixed or calibrated from a recall target;
+//   - the surviving posting lists are fetched in batches of concurrent reads
+//     and scanned closest-first, skipping lists whose triangle-inequality
+//     bound cannot beat the current k-th distance.
+//
+// SPANN's pruning rules are defined on euclidean distance, so the index is L2 only.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "kmeans.h"
+#include "posting_codec.h"
+#include "range_search.h"
+#include "thread_pool.h"
+#include "topk.h"
+#include "types.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+struct spann_params {
+    size_t        max_posting = 256;  // cluster size bound before replication
+    size_t        branching   = 8;
+    size_t        replicas    = 8;    // max postings a vector is written to
+    float         replica_eps = 0.1f;
+    kmeans_params kmeans;
+    graph_params  centroid_graph;
+};
+
+struct spann_search_params {
+    size_t max_probes = 64;
+    float  probe_eps  = 0.2f;
+    size_t ef         = 128; // centroid graph beam width
+
+    bool   calibrated    = false; // use the probe ratio learnt by spann_index::calibrate
+    bool   bound_pruning = true;  // skip lists that cannot beat the current k-th distance
+    size_t io_batch      = 8;    // lists fetched per read wave
+};
+
+struct spann_stats {
+    size_t probes          = 0; // posting lists read
+    size_t pruned          = 0; // candidate lists skipped by the probe ratio
+    size_t bound_skipped   = 0; // lists the triangle-inequality bound skipped, read or not
+    size_t bytes_read      = 0;
+    size_t vectors_scanned = 0;
+};
+
+// Batched positional reads against one file, served by a small I/O pool.
+class posting_reader {
+public:
+    posting_reader(const std::string & path, size_t io_threads) : pool_(std::make_unique<thread_pool>(io_threads)) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "posting_reader: open " + path);
+        }
+    }
+
+    posting_reader(const posting_reader &)             = delete;
+    posting_reader & operator=(const posting_reader &) = delete;
+
+    // The pool finishes every queued read before the fd they use is closed.
+    ~posting_reader() {
+        pool_.reset();
+        ::close(fd_);
+    }
+
+    struct range {
+        uint64_t offset;
+        size_t   length;
+    };
+
+    // All reads are queued at once; each future completes independently.
+    // Buffers carry svb_padding spare bytes so encoded ids decode in place.
+    std::vector<std::future<std::vector<uint8_t>>> read_batch(const std::vector<range> & ranges) {
+        std::vector<std::future<std::vector<uint8_t>>> out;
+        out.reserve(ranges.size());
+        for (const range & r : ranges) {
+            out.push_back(pool_->submit([fd = fd_, r] {
+                std::vector<uint8_t> buf(r.length + svb_padding);
+                size_t               got = 0;
+                while (got < r.length) {
+                    const ssize_t n = ::pread(fd, buf.data() + got, r.length - got, static_cast<off_t>(r.offset + got));
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        throw std::system_error(n < 0 ? errno : EIO, std::generic_category(), "posting_reader: pread");
+                    }
+                    got += static_cast<size_t>(n);
+                }
+                return buf;
+            }));
+        }
+        return out;
+    }
+
+private:
+    std::unique_ptr<thread_pool> pool_;
+    int                          fd_ = -1;
+};
+
+class spann_index {
+public:
+    // Posting record in the file: the ids encoded with encode_posting, padded
+    // to 4 bytes (id_bytes in total), followed by count * dim floats and a
+    // home bitmap of (count + 7) / 8 bytes: bit i is set when this is member
+    // i's closest list, the one copy of it that is not a replica.
+    struct posting {
+        uint64_t offset   = 0;
+        uint32_t count    = 0;
+        uint32_t id_bytes = 0;
+        float    radius   = 0; // largest euclidean distance from the centroid to a member
+    };
+
+    size_t record_bytes(const posting & p) const {
+        return p.id_bytes + p.count * dim_ * sizeof(float) + (p.count + 7) / 8;
+    }
+
+    static spann_index build(const float * x, size_t n, size_t dim, const std::string & path, spann_params p = {},
+                             size_t io_threads = 4) {
+        check_dim(dim);
+        if (n == 0) {
+            throw std::invalid_argument("spann_index: empty collection");
+        }
+        p.centroid_graph.m = metric::l2;
+
+        const std::vector<float> cent = hierarchical_kmeans(x, n, dim, p.max_posting, p.branching, p.kmeans);
+        const size_t             nc   = cent.size() / dim;
+        auto                     g    = std::make_unique<graph_index>(dim, p.centroid_graph);
+        g->add(cent.data(), nc);
+
+        std::vector<std::vector<uint32_t>> lists(nc);
+        std::vector<std::vector<uint8_t>>  home(nc); // per member: 1 in its closest list
+        const float                        bound = (1 + p.replica_eps) * (1 + p.replica_eps);
+        for (size_t i = 0; i < n; ++i) {
+            const float * v     = x + i * dim;
+            auto          cands = g->search(v, std::max<size_t>(p.replicas * 2, 1), p.centroid_graph.ef_construction);
+            std::vector<uint32_t> chosen;
+            for (const neighbor & c : cands) {
+                if (chosen.size() >= std::max<size_t>(p.replicas, 1) || c.dist > bound * cands[0].dist) {
+                    break;
+                }
+                const uint32_t cid = static_cast<uint32_t>(c.id);
+                bool           rng = false;
+                for (uint32_t o : chosen) {
+                    if (l2_sqr(g->vector(o), g->vector(cid), dim) < c.dist) {
+                        rng = true;
+                        break;
+                    }
+                }
+                if (!rng) {
+                    chosen.push_back(cid);
+                }
+            }
+            for (uint32_t cid : chosen) {
+                lists[cid].push_back(static_cast<uint32_t>(i));
+                home[cid].push_back(cid == chosen[0]);
+            }
+        }
+
+        spann_index idx;
+        idx.dim_       = dim;
+        idx.replicas_  = std::max<size_t>(p.replicas, 1);
+        idx.centroids_ = std::move(g);
+        idx.postings_.resize(nc);
+
+        std::FILE * f = std::fopen(path.c_str(), "wb");
+        if (!f) {
+            throw std::system_error(errno, std::generic_category(), "spann_index: open " + path);
+        }
+        uint64_t off = 0;
+        for (size_t c = 0; c < nc; ++c) {
+            // Ids were appended in increasing order, so every list is already sorted.
+            const auto &         l   = lists[c];
+            std::vector<uint8_t> enc = encode_posting(l);
+            enc.resize((enc.size() + 3) / 4 * 4);
+            bool ok = std::fwrite(enc.data(), 1, enc.size(), f) == enc.size();
+            for (uint32_t id : l) {
+                ok = ok && std::fwrite(x + static_cast<size_t>(id) * dim, sizeof(float), dim, f) == dim;
+            }
+            std::vector<uint8_t> bits((l.size() + 7) / 8, 0);
+            for (size_t i = 0; i < l.size(); ++i) {
+                bits[i / 8] |= static_cast<uint8_t>(home[c][i] << (i % 8));
+            }
+            ok = ok && std::fwrite(bits.data(), 1, bits.size(), f) == bits.size();
+            if (!ok) {
+                std::fclose(f);
+                throw std::system_error(errno, std::generic_category(), "spann_index: write " + path);
+            }
+            float radius = 0;
+            for (uint32_t id : l) {
+                radius = std::max(radius, l2_sqr(x + static_cast<size_t>(id) * dim, idx.centroids_->vector(c), dim));
+            }
+            idx.postings_[c] = {off, static_cast<uint32_t>(l.size()), static_cast<uint32_t>(enc.size()),
+                                std::sqrt(radius)};
+            off += idx.record_bytes(idx.postings_[c]);
+        }
+        if (std::fclose(f) != 0) {
+            throw std::system_error(errno, std::generic_category(), "spann_index: close " + path);
+        }
+        idx.reader_ = std::make_unique<posting_reader>(path, io_threads);
+        return idx;
+    }
+
+    size_t                       dim() const { return dim_; }
+    size_t                       n_postings() const { return postings_.size(); }
+    const std::vector<posting> & postings() const { return postings_; }
+    const graph_index &          centroids() const { return *centroids_; }
+
+    // Probe lists are chosen per query: only centroids within (1 + eps) of the
+    // closest are read, where eps is probe_eps, or the value learnt by
+    // calibrate() when sp.calibrated is set. The closest list is read
+    // alone, the rest in waves of io_batch, and a list is skipped (before its
+    // read, or before its scan when a list earlier in the wave tightened the
+    // bound) once the triangle inequality proves that none of its vectors,
+    // all within `radius` of the centroid, can beat the current k-th distance.
+    std::vector<neighbor> search(const float * q, size_t k, const spann_search_params & sp = {},
+                                 spann_stats * stats = nullptr) const {
+        if (k == 0) {
+            return {};
+        }
+        std::vector<neighbor> cents = centroids_->search(q, sp.max_probes, sp.ef);
+        const float           learnt = calibrated_eps_->load(std::memory_order_relaxed);
+        const float           eps    = sp.calibrated && learnt >= 0 ? learnt : sp.probe_eps;
+        const float           bound = (1 + eps) * (1 + eps);
+        size_t                keep  = 0;
+        while (keep < cents.size() && cents[keep].dist <= bound * cents[0].dist) {
+            ++keep;
+        }
+
+        topk_collector            top(k);
+        std::unordered_set<idx_t> seen;
+        scan_buffers              scratch;
+        size_t                    probes = 0, skipped = 0, bytes = 0, scanned = 0;
+        auto                      bounded = [&](size_t i, const posting & p) {
+            return sp.bound_pruning && lower_bound(cents[i].dist, p.radius) >= top.bound();
+        };
+        // The first wave is the closest list alone, so the bound is finite
+        // before the larger waves are issued.
+        for (size_t w = 0, batch = 1; w < keep; w += batch, batch = std::max<size_t>(sp.io_batch, 1)) {
+            std::vector<posting_reader::range> ranges;
+            std::vector<size_t>                lists;
+            for (size_t i = w; i < std::min(keep, w + batch); ++i) {
+                const posting & p = postings_[static_cast<size_t>(cents[i].id)];
+                if (p.count == 0) {
+                    continue;
+                }
+                if (bounded(i, p)) {
+                    ++skipped;
+                    continue;
+                }
+                ranges.push_back({p.offset, record_bytes(p)});
+                lists.push_back(i);
+            }
+            auto reads = reader_->read_batch(ranges);
+            for (size_t i = 0; i < reads.size(); ++i) {
+                const std::vector<uint8_t> buf = reads[i].get();
+                bytes += ranges[i].length;
+                ++probes;
+                // Lists scanned earlier in the wave may have tightened the bound.
+                const posting & p = postings_[static_cast<size_t>(cents[lists[i]].id)];
+                if (bounded(lists[i], p)) {
+                    ++skipped;
+                    continue;
+                }
+                scanned += scan(q, buf, p, top, seen, scratch);
+            }
+        }
+
+        if (stats) {
+            stats->probes += probes;
+            stats->pruned += cents.size() - keep;
+            stats->bound_skipped += skipped;
+            stats->bytes_read += bytes;
+            stats->vectors_scanned += scanned;
+        }
+        return top.results();
+    }
+
+    // Learns the probe ratio that lets `recall_target` of the sample queries
+    // reach recall_target recall@k against their exact k nearest neighbors,
+    // and uses it whenever spann_search_params::calibrated is set. The exact
+    // neighbors come from one pass over every posting list (a vector counts
+    // in its home list only), so this reads the whole file once; keep the
+    // sample to a few hundred queries. A query whose max_probes closest lists
+    // never reach the target needs all of them.
+    float calibrate(const float * queries, size_t nq, size_t k, float recall_target, spann_search_params sp = {}) {
+        if (nq == 0 || k == 0 || recall_target <= 0 || recall_target > 1) {
+            throw std::invalid_argument("spann_index: calibrate needs queries, k > 0 and recall_target in (0, 1]");
+        }
+        const std::vector<std::vector<neighbor>> truth = exact_knn(queries, nq, k, sp.io_batch);
+        std::vector<float>                       needed;
+        for (size_t qi = 0; qi < nq; ++qi) {
+            const float *         q     = queries + qi * dim_;
+            std::vector<neighbor> cents = centroids_->search(q, sp.max_probes, sp.ef);
+            if (cents.empty() || truth[qi].empty()) {
+                continue;
+            }
+            // Scan lists closest-first until the target recall is reached.
+            topk_collector            top(k);
+            std::unordered_set<idx_t> seen;
+            scan_buffers              scratch;
+            float                     eps = 0;
+            for (const neighbor & c : cents) {
+                const posting & p = postings_[static_cast<size_t>(c.id)];
+                if (p.count > 0) {
+                    auto reads = reader_->read_batch({{p.offset, record_bytes(p)}});
+                    scan(q, reads[0].get(), p, top, seen, scratch);
+                }
+                eps                          = cents[0].dist > 0 ? std::sqrt(c.dist / cents[0].dist) - 1 : 0;
+                std::vector<neighbor> cur    = top.results();
+                size_t                hits   = 0;
+                for (const neighbor & t : truth[qi]) {
+                    hits += std::any_of(cur.begin(), cur.end(), [&](const neighbor & r) { return r.id == t.id; });
+                }
+                for (const neighbor & r : cur) {
+                    top.push(r.dist, r.id);
+                }
+                if (static_cast<float>(hits) >= recall_target * static_cast<float>(truth[qi].size())) {
+                    break;
+                }
+            }
+            needed.push_back(eps);
+        }
+        if (needed.empty()) {
+            return calibrated_eps();
+        }
+        std::sort(needed.begin(), needed.end());
+        const size_t at = std::min(needed.size() - 1,
+                                   static_cast<size_t>(std::ceil(recall_target * static_cast<float>(needed.size()))) - 1);
+        calibrated_eps_->store(needed[at], std::memory_order_relaxed);
+        return needed[at];
+    }
+
+    // Negative until calibrate() has run.
+    float calibrated_eps() const { return calibrated_eps_->load(std::memory_order_relaxed); }
+
+    // Every vector within squared distance `radius` of q, streamed to `sink`
+    // in chunks (see range_search.h). All centroids are checked: lists whose
+    // triangle-inequality bound exceeds radius are skipped, which loses
+    // nothing, and the rest are read in waves of io_batch, closest first.
+    // Replicas are dropped by the home bitmap: a hit is emitted only from its
+    // closest list, which the bound can never skip (the hit lies within its
+    // radius), so no per-hit state is kept and memory stays flat.
+    template <typename Sink>
+    size_t range_search(const float * q, float radius, Sink && sink, const spann_search_params & sp = {},
+                        size_t chunk_size = 1024, spann_stats * stats = nullptr) const {
+        std::vector<std::pair<float, size_t>> lists; // (bound, posting)
+        size_t                                pruned = 0;
+        for (size_t c = 0; c < postings_.size(); ++c) {
+            if (postings_[c].count == 0) {
+                continue;
+            }
+            const float lb = lower_bound(l2_sqr(q, centroids_->vector(static_cast<uint32_t>(c)), dim_), postings_[c].radius);
+            if (lb <= radius) {
+                lists.emplace_back(lb, c);
+            } else {
+                ++pruned;
+            }
+        }
+        std::sort(lists.begin(), lists.end());
+
+        range_buffer<Sink>    out(sink, chunk_size);
+        std::vector<uint32_t> raw;
+        std::vector<float>    dist;
+        size_t                probes = 0, bytes = 0, scanned = 0;
+        const size_t          batch  = std::max<size_t>(sp.io_batch, 1);
+        for (size_t w = 0; w < lists.size() && !out.stopped(); w += batch) {
+            std::vector<posting_reader::range> ranges;
+            for (size_t i = w; i < std::min(lists.size(), w + batch); ++i) {
+                const posting & p = postings_[lists[i].second];
+                ranges.push_back({p.offset, record_bytes(p)});
+            }
+            auto reads = reader_->read_batch(ranges);
+            for (size_t i = 0; i < reads.size() && !out.stopped(); ++i) {
+                const std::vector<uint8_t> buf = reads[i].get();
+                const posting &            p   = postings_[lists[w + i].second];
+                const posting_view         pv(buf.data());
+                const size_t               cnt  = pv.size();
+                const uint8_t *            home = buf.data() + p.id_bytes + cnt * dim_ * sizeof(float);
+                raw.resize(cnt);
+                pv.decode(raw.data());
+                dist.resize(cnt);
+                distance_block(metric::l2, q, reinterpret_cast<const float *>(buf.data() + p.id_bytes), cnt, dim_,
+                               dist.data());
+                for (size_t j = 0; j < cnt; ++j) {
+                    if (dist[j] <= radius && (home[j / 8] >> (j % 8) & 1) && !out.push(dist[j], raw[j])) {
+                        break;
+                    }
+                }
+                scanned += cnt;
+                bytes += ranges[i].length;
+                ++probes;
+            }
+        }
+        out.flush();
+        if (stats) {
+            stats->probes += probes;
+            stats->bound_skipped += pruned;
+            stats->bytes_read += bytes;
+            stats->vectors_scanned += scanned;
+        }
+        return out.total();
+    }
+
+private:
+    spann_index() = default;
+
+    struct scan_buffers {
+        std::vector<float>    dist;
+        std::vector<uint32_t> raw;
+        std::vector<float>    keep_dist;
+        std::vector<idx_t>    keep_ids;
+    };
+
+    // Smallest possible squared distance from q to a vector of a list whose
+    // centroid is at squared distance `centroid_dist` and whose radius is r.
+    static float lower_bound(float centroid_dist, float r) {
+        const float gap = std::sqrt(centroid_dist) - r;
+        return gap > 0 ? gap * gap : 0.0f;
+    }
+
+    // Exact k nearest neighbors of each query, from one pass over every list
+    // read in waves of io_batch. Only home entries count, so each vector is
+    // seen once.
+    std::vector<std::vector<neighbor>> exact_knn(const float * queries, size_t nq, size_t k, size_t io_batch) const {
+        std::vector<topk_collector> tops;
+        tops.reserve(nq);
+        for (size_t qi = 0; qi < nq; ++qi) {
+            tops.emplace_back(k);
+        }
+        std::vector<uint32_t> raw;
+        std::vector<float>    dist;
+        const size_t          batch = std::max<size_t>(io_batch, 1);
+        for (size_t c = 0; c < postings_.size(); c += batch) {
+            std::vector<posting_reader::range> ranges;
+            std::vector<size_t>                lists;
+            for (size_t i = c; i < std::min(postings_.size(), c + batch); ++i) {
+                if (postings_[i].count > 0) {
+                    ranges.push_back({postings_[i].offset, record_bytes(postings_[i])});
+                    lists.push_back(i);
+                }
+            }
+            auto reads = reader_->read_batch(ranges);
+            for (size_t i = 0; i < reads.size(); ++i) {
+                const std::vector<uint8_t> buf = reads[i].get();
+                const posting &            p   = postings_[lists[i]];
+                const posting_view         pv(buf.data());
+                const size_t               cnt  = pv.size();
+                const float *              vec  = reinterpret_cast<const float *>(buf.data() + p.id_bytes);
+                const uint8_t *            home = buf.data() + p.id_bytes + cnt * dim_ * sizeof(float);
+                raw.resize(cnt);
+                pv.decode(raw.data());
+                dist.resize(cnt);
+                for (size_t qi = 0; qi < nq; ++qi) {
+                    distance_block(metric::l2, queries + qi * dim_, vec, cnt, dim_, dist.data());
+                    for (size_t j = 0; j < cnt; ++j) {
+                        if (home[j / 8] >> (j % 8) & 1) {
+                            tops[qi].push(dist[j], raw[j]);
+                        }
+                    }
+                }
+            }
+        }
+        std::vector<std::vector<neighbor>> out(nq);
+        for (size_t qi = 0; qi < nq; ++qi) {
+            out[qi] = tops[qi].results();
+        }
+        return out;
+    }
+
+    // Scans one posting record into `top`. Replicas of a vector already seen
+    // are dropped so the collector threshold is the true k-th distance.
+    size_t scan(const float * q, const std::vector<uint8_t> & buf, const posting & p, topk_collector & top,
+                std::unordered_set<idx_t> & seen, scan_buffers & s) const {
+        const posting_view pv(buf.data());
+        const size_t       cnt = pv.size();
+        const float *      vec = reinterpret_cast<const float *>(buf.data() + p.id_bytes);
+        s.raw.resize(cnt);
+        pv.decode(s.raw.data());
+        s.dist.resize(cnt);
+        distance_block(metric::l2, q, vec, cnt, dim_, s.dist.data());
+        s.keep_dist.clear();
+        s.keep_ids.clear();
+        const float kth = top.threshold();
+        for (size_t i = 0; i < cnt; ++i) {
+            if (s.dist[i] < kth && seen.insert(s.raw[i]).second) {
+                s.keep_dist.push_back(s.dist[i]);
+                s.keep_ids.push_back(s.raw[i]);
+            }
+        }
+        top.push_block(s.keep_dist.data(), s.keep_ids.data(), s.keep_dist.size());
+        return cnt;
+    }
+
+    size_t dim_      = 0;
+    size_t replicas_ = 1;
+    // Written by calibrate() while searches may read it; boxed to keep the index movable.
+    std::unique_ptr<std::atomic<float>> calibrated_eps_ = std::make_unique<std::atomic<float>>(-1.0f);
+    std::unique_ptr<graph_index>        centroids_;
+    std::vector<posting>                postings_;
+    std::unique_ptr<posting_reader>     reader_;
+};
+
+} // namespace e4b
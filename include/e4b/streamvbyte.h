@@ -0,0 +1,136 @@
+// e4b: Embedding database in C/C++
+// StreamVByte integer compression (Lemire, Kurz, Rupp).
+//
+// Values are stored as 1-4 little-endian bytes each; their lengths live in a
+// separate control stream, 2 bits per value. The split lets the decoder
+// expand four values with a single pshufb driven by a 256-entry table.
+// The delta variants store differences to the previous value, which keeps
+// sorted id lists (neighbor lists, postings) mostly in one-byte codes.
+//
+// Layout for n values: (n + 3) / 4 control bytes, then the data bytes.
+// The SIMD decoder may read up to svb_padding bytes past the encoded data,
+// so buffers handed to the decoders must provide that slack.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace e4b {
+
+constexpr size_t svb_padding = 16;
+
+// Upper bound on the encoded size of n values.
+inline size_t svb_max_bytes(size_t n) {
+    return (n + 3) / 4 + 4 * n;
+}
+
+namespace detail {
+
+struct svb_tables {
+    uint8_t shuffle[256][16];
+    uint8_t length[256];
+
+    constexpr svb_tables() : shuffle{}, length{} {
+        for (int c = 0; c < 256; ++c) {
+            uint8_t off = 0;
+            for (int j = 0; j < 4; ++j) {
+                const int len = ((c >> (2 * j)) & 3) + 1;
+                for (int b = 0; b < 4; ++b) {
+                    shuffle[c][4 * j + b] = b < len ? static_cast<uint8_t>(off + b) : 0xFF;
+                }
+                off = static_cast<uint8_t>(off + len);
+            }
+            length[c] = off;
+        }
+    }
+};
+
+inline constexpr svb_tables svb_table{};
+
+inline uint8_t svb_code(uint32_t v) {
+    return v < (1u << 8) ? 0 : v < (1u << 16) ? 1 : v < (1u << 24) ? 2 : 3;
+}
+
+template <bool Delta>
+inline size_t svb_encode_impl(const uint32_t * in, size_t n, uint8_t * out, uint32_t prev) {
+    uint8_t * ctrl = out;
+    uint8_t * data = out + (n + 3) / 4;
+    std::memset(ctrl, 0, (n + 3) / 4);
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t v    = Delta ? in[i] - prev : in[i];
+        const uint8_t  code = svb_code(v);
+        prev                = in[i];
+        ctrl[i / 4] |= static_cast<uint8_t>(code << (2 * (i % 4)));
+        for (int b = 0; b <= code; ++b) {
+            *data++ = static_cast<uint8_t>(v >> (8 * b));
+        }
+    }
+    return static_cast<size_t>(data - out);
+}
+
+template <bool Delta>
+inline size_t svb_decode_impl(const uint8_t * in, size_t n, uint32_t * out, uint32_t prev) {
+    const uint8_t * ctrl = in;
+    const uint8_t * data = in + (n + 3) / 4;
+    size_t          i    = 0;
+#if defined(__SSSE3__)
+    __m128i base = _mm_set1_epi32(static_cast<int>(prev));
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t c = ctrl[i / 4];
+        __m128i       v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        v = _mm_shuffle_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(svb_table.shuffle[c])));
+        if (Delta) {
+            v    = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v    = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v    = _mm_add_epi32(v, base);
+            base = _mm_shuffle_epi32(v, 0xFF);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+        data += svb_table.length[c];
+    }
+    if (Delta && i > 0) {
+        prev = out[i - 1];
+    }
+#endif
+    for (; i < n; ++i) {
+        const int code = (ctrl[i / 4] >> (2 * (i % 4))) & 3;
+        uint32_t  v    = 0;
+        for (int b = 0; b <= code; ++b) {
+            v |= static_cast<uint32_t>(*data++) << (8 * b);
+        }
+        if (Delta) {
+            v += prev;
+            prev = v;
+        }
+        out[i] = v;
+    }
+    return static_cast<size_t>(data - in);
+}
+
+} // namespace detail
+
+// Returns the number of bytes written (at most svb_max_bytes(n)).
+inline size_t svb_encode(const uint32_t * in, size_t n, uint8_t * out) {
+    return detail::svb_encode_impl<false>(in, n, out, 0);
+}
+
+// `in` must be non-decreasing and >= prev.
+inline size_t svb_encode_delta(const uint32_t * in, size_t n, uint8_t * out, uint32_t prev = 0) {
+    return detail::svb_encode_impl<true>(in, n, out, prev);
+}
+
+// Returns the number of encoded bytes consumed.
+inline size_t svb_decode(const uint8_t * in, size_t n, uint32_t * out) {
+    return detail::svb_decode_impl<false>(in, n, out, 0);
+}
+
+inline size_t svb_decode_delta(const uint8_t * in, size_t n, uint32_t * out, uint32_t prev = 0) {
+    return detail::svb_decode_impl<true>(in, n, out, prev);
+}
+
+} // namespace e4b
@@ -0,0 +1,107 @@
+// e4b: Embedding database in C/C++
+// Fixed-size worker pool for background I/O and parallel builds.
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+class thread_pool {
+public:
+    explicit thread_pool(size_t n_threads = std::thread::hardware_concurrency()) {
+        n_threads = n_threads == 0 ? 1 : n_threads;
+        for (size_t i = 0; i < n_threads; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    thread_pool(const thread_pool &)             = delete;
+    thread_pool & operator=(const thread_pool &) = delete;
+
+    // Finishes the queued tasks, then joins.
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (std::thread & t : workers_) {
+            t.join();
+        }
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    template <typename F>
+    auto submit(F && f) -> std::future<std::invoke_result_t<F>> {
+        using R   = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto fut  = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([task] { (*task)(); });
+        }
+        cv_.notify_one();
+        return fut;
+    }
+
+    // Runs fn(i) for i in [0, n) on the pool and waits for all of them; the
+    // first exception is rethrown only once no task still refers to fn.
+    template <typename F>
+    void parallel_for(size_t n, F && fn) {
+        std::vector<std::future<void>> futs;
+        futs.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            futs.push_back(submit([&fn, i] { fn(i); }));
+        }
+        std::exception_ptr error;
+        for (auto & f : futs) {
+            try {
+                f.get();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread>          workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex                        mutex_;
+    std::condition_variable           cv_;
+    bool                              stopping_ = false;
+};
+
+} // namespace e4b
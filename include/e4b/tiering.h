@@ -0,0 +1,248 @@
+// e4b: Embedding database in C/C++
+// Access-frequency driven placement of segments across storage tiers.
+//
+//   hot  - resident in RAM
+//   warm - mmap-backed, paged in from SSD on demand (see mapped_file.h)
+//   cold - compressed on disk, decompressed on access
+//
+// Queries call access_tracker::record() for every segment they touch. A
+// tier_manager periodically folds those counts into an exponentially decayed
+// heat score, plans a placement that keeps the hottest segments in RAM within
+// the configured budget, and asks the tier_store to carry out the moves.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace e4b {
+
+using segment_id = uint32_t;
+
+enum class tier : uint8_t {
+    hot,
+    warm,
+    cold,
+};
+
+// Lock-free hit counters, one per segment. Counters live in fixed-size
+// chunks reached through a fixed chunk table, so they never move: record()
+// and drain() are plain atomic loads and adds with no lock, and only
+// add_segment() (rare, off the query path) serialises on a mutex.
+class access_tracker {
+public:
+    static constexpr size_t chunk_size = 1024;
+    static constexpr size_t max_chunks = 4096; // 4M segments
+
+    access_tracker() = default;
+
+    access_tracker(const access_tracker &)             = delete;
+    access_tracker & operator=(const access_tracker &) = delete;
+
+    ~access_tracker() {
+        for (auto & c : chunks_) {
+            delete[] c.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the id of the newly tracked segment.
+    segment_id add_segment() {
+        std::lock_guard<std::mutex> lock(add_mutex_);
+        const size_t                s = size_.load(std::memory_order_relaxed);
+        if (s % chunk_size == 0) {
+            if (s / chunk_size >= max_chunks) {
+                throw std::length_error("access_tracker: too many segments");
+            }
+            chunks_[s / chunk_size].store(new std::atomic<uint64_t>[chunk_size](), std::memory_order_relaxed);
+        }
+        // Publishes the chunk along with the new size.
+        size_.store(s + 1, std::memory_order_release);
+        return static_cast<segment_id>(s);
+    }
+
+    size_t segment_count() const { return size_.load(std::memory_order_acquire); }
+
+    void record(segment_id s, uint64_t hits = 1) {
+        if (s < size_.load(std::memory_order_acquire)) {
+            counter(s).fetch_add(hits, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the counts accumulated since the previous drain and zeroes them.
+    std::vector<uint64_t> drain() {
+        std::vector<uint64_t> out(size_.load(std::memory_order_acquire));
+        for (size_t i = 0; i < out.size(); ++i) {
+            out[i] = counter(static_cast<segment_id>(i)).exchange(0, std::memory_order_relaxed);
+        }
+        return out;
+    }
+
+private:
+    std::atomic<uint64_t> & counter(segment_id s) const {
+        return chunks_[s / chunk_size].load(std::memory_order_relaxed)[s % chunk_size];
+    }
+
+    std::mutex                           add_mutex_;
+    std::atomic<size_t>                  size_{0};
+    std::atomic<std::atomic<uint64_t> *> chunks_[max_chunks] = {};
+};
+
+// Implemented by the segment storage layer. move() may block on I/O; it is
+// only ever called from the tier_manager thread.
+class tier_store {
+public:
+    virtual ~tier_store() = default;
+
+    virtual size_t segment_count() const            = 0;
+    virtual size_t ram_bytes(segment_id s) const    = 0; // cost of keeping s hot
+    virtual tier   current_tier(segment_id s) const = 0;
+    virtual void   move(segment_id s, tier to)      = 0;
+};
+
+struct tier_config {
+    size_t                    ram_budget = 0;        // bytes available to hot segments
+    double                    decay      = 0.5;      // heat = heat * decay + hits, per interval
+    double                    cold_heat  = 0.5;      // segments cooler than this go cold
+    double                    hysteresis = 0.25;     // bonus for staying in the current tier
+    std::chrono::milliseconds interval{1000};
+};
+
+struct tier_move {
+    segment_id segment;
+    tier       from;
+    tier       to;
+};
+
+// Computes the moves that bring the store to the ideal placement for the given
+// heat scores. Demotions come first so that RAM is freed before it is reused.
+inline std::vector<tier_move> plan_tiers(const std::vector<double> & heat, const tier_store & store,
+                                         const tier_config & cfg) {
+    const size_t n = std::min(heat.size(), store.segment_count());
+
+    std::vector<double>     score(n);
+    std::vector<segment_id> order(n);
+    for (size_t i = 0; i < n; ++i) {
+        const bool hot = store.current_tier(static_cast<segment_id>(i)) == tier::hot;
+        score[i]       = heat[i] * (hot ? 1.0 + cfg.hysteresis : 1.0);
+        order[i]       = static_cast<segment_id>(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](segment_id a, segment_id b) { return score[a] > score[b]; });
+
+    std::vector<tier> target(n, tier::warm);
+    size_t            used = 0;
+    for (segment_id s : order) {
+        const size_t bytes = store.ram_bytes(s);
+        if (heat[s] > 0.0 && used + bytes <= cfg.ram_budget) {
+            target[s] = tier::hot;
+            used += bytes;
+            continue;
+        }
+        const bool   cold = store.current_tier(s) == tier::cold;
+        const double bar  = cold ? cfg.cold_heat * (1.0 + cfg.hysteresis) : cfg.cold_heat;
+        target[s]         = heat[s] < bar ? tier::cold : tier::warm;
+    }
+
+    std::vector<tier_move> demotions;
+    std::vector<tier_move> promotions;
+    for (size_t i = 0; i < n; ++i) {
+        const segment_id s   = static_cast<segment_id>(i);
+        const tier       cur = store.current_tier(s);
+        if (cur == target[i]) {
+            continue;
+        }
+        (cur == tier::hot ? demotions : promotions).push_back({s, cur, target[i]});
+    }
+    demotions.insert(demotions.end(), promotions.begin(), promotions.end());
+    return demotions;
+}
+
+// Background promotion / demotion loop.
+class tier_manager {
+public:
+    tier_manager(access_tracker & tracker, tier_store & store, tier_config cfg)
+        : tracker_(tracker), store_(store), cfg_(cfg) {
+        if (cfg_.decay < 0.0 || cfg_.decay > 1.0) {
+            throw std::invalid_argument("tier_manager: decay must be in [0, 1]");
+        }
+    }
+
+    tier_manager(const tier_manager &)             = delete;
+    tier_manager & operator=(const tier_manager &) = delete;
+
+    ~tier_manager() { stop(); }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (thread_.joinable()) {
+            return;
+        }
+        stopping_ = false;
+        thread_   = std::thread([this] { loop(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    // One decay / plan / apply round. Returns the number of moves applied.
+    size_t run_once() {
+        std::lock_guard<std::mutex> lock(round_mutex_);
+        const std::vector<uint64_t> hits = tracker_.drain();
+        if (heat_.size() < hits.size()) {
+            heat_.resize(hits.size(), 0.0);
+        }
+        for (size_t i = 0; i < hits.size(); ++i) {
+            heat_[i] = heat_[i] * cfg_.decay + static_cast<double>(hits[i]);
+        }
+        const std::vector<tier_move> moves = plan_tiers(heat_, store_, cfg_);
+        for (const tier_move & m : moves) {
+            store_.move(m.segment, m.to);
+        }
+        moves_total_.fetch_add(moves.size(), std::memory_order_relaxed);
+        return moves.size();
+    }
+
+    std::vector<double> heat() const {
+        std::lock_guard<std::mutex> lock(round_mutex_);
+        return heat_;
+    }
+
+    uint64_t moves_total() const { return moves_total_.load(std::memory_order_relaxed); }
+
+private:
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, cfg_.interval, [this] { return stopping_; })) {
+            lock.unlock();
+            run_once();
+            lock.lock();
+        }
+    }
+
+    access_tracker &        tracker_;
+    tier_store &            store_;
+    tier_config             cfg_;
+    std::vector<double>     heat_;
+    std::atomic<uint64_t>   moves_total_{0};
+    mutable std::mutex      round_mutex_;
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    bool                    stopping_ = false;
+    std::thread             thread_;
+};
+
+} // namespace e4b
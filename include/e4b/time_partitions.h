@@ -0,0 +1,204 @@
+// e4b: Embedding database in C/C++
+// Time-partitioned collections with TTL by whole-bucket drops.
+//
+// Rows go to the bucket covering their timestamp (bucket_width wide). A
+// bucket is scanned flat while small and gets its own graph_index once it
+// exceeds flat_threshold rows, as label partitions do. Expiry releases whole
+// buckets: no row is deleted one by one and nothing is compacted.
+//
+// Queries may restrict to a time window: buckets outside it are skipped and
+// buckets straddling its edges filter rows by timestamp. With time decay,
+// older rows are pushed back by an additive penalty
+//   weight * (1 - 2^(-age / half_life))
+// on their distance, so ranking blends similarity and recency whatever the
+// metric. Within a graph bucket, candidates are chosen by raw distance before
+// the penalty is applied.
+#pragma once
+
+#include "distance.h"
+#include "graph_index.h"
+#include "topk.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace e4b {
+
+struct time_partition_params {
+    int64_t      bucket_width   = 86400; // in timestamp units
+    int64_t      ttl            = 0;     // rows older than this expire; 0 keeps everything
+    size_t       flat_threshold = 4096;  // buckets above this size get a graph
+    graph_params graph;                  // graph_params::m is also the flat scan metric
+    size_t       ef = 64;                // graph search beam width
+};
+
+// Inclusive timestamp window.
+struct time_window {
+    int64_t from = std::numeric_limits<int64_t>::min();
+    int64_t to   = std::numeric_limits<int64_t>::max();
+};
+
+// Recency penalty relative to `now`; off while weight is 0.
+struct time_decay {
+    int64_t now       = 0;
+    double  half_life = 1;
+    float   weight    = 0;
+
+    float penalty(int64_t t) const {
+        if (weight == 0 || t >= now) {
+            return 0;
+        }
+        const double age = static_cast<double>(now - t);
+        return weight * static_cast<float>(1 - std::exp2(-age / half_life));
+    }
+};
+
+struct time_search_stats {
+    size_t buckets_searched = 0;
+    size_t buckets_skipped  = 0; // outside the window
+    size_t buckets_pruned   = 0; // decay penalty alone exceeds the k-th score (l2 only)
+};
+
+class time_partitioned_collection {
+public:
+    time_partitioned_collection(size_t dim, time_partition_params p = {}) : dim_(dim), params_(p) {
+        check_dim(dim);
+        if (p.bucket_width <= 0) {
+            throw std::invalid_argument("time_partitioned_collection: bucket_width must be > 0");
+        }
+    }
+
+    size_t dim() const { return dim_; }
+    size_t bucket_count() const { return buckets_.size(); }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto & kv : buckets_) {
+            n += kv.second.ids.size();
+        }
+        return n;
+    }
+
+    // Start of the bucket holding timestamp t.
+    int64_t bucket_of(int64_t t) const {
+        const int64_t r = t % params_.bucket_width;
+        return t - (r < 0 ? r + params_.bucket_width : r);
+    }
+
+    void add(const float * x, const idx_t * ids, const int64_t * timestamps, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            bucket & b = buckets_[bucket_of(timestamps[i])];
+            b.ids.push_back(ids[i]);
+            b.ts.push_back(timestamps[i]);
+            b.t_min = std::min(b.t_min, timestamps[i]);
+            b.t_max = std::max(b.t_max, timestamps[i]);
+            if (b.graph) {
+                b.graph->add(x + i * dim_, 1);
+                continue;
+            }
+            b.data.insert(b.data.end(), x + i * dim_, x + (i + 1) * dim_);
+            if (b.ids.size() > params_.flat_threshold) {
+                b.graph = std::make_unique<graph_index>(dim_, params_.graph);
+                b.graph->add(b.data.data(), b.ids.size());
+                std::vector<float>().swap(b.data);
+            }
+        }
+    }
+
+    // Drops every bucket that lies entirely before now - ttl; returns the
+    // number of rows released. Rows of the boundary bucket stay until their
+    // whole bucket has expired; use a time_window to hide them earlier.
+    size_t expire(int64_t now) {
+        if (params_.ttl <= 0) {
+            return 0;
+        }
+        const int64_t horizon = now - params_.ttl;
+        size_t        rows    = 0;
+        auto          it      = buckets_.begin();
+        while (it != buckets_.end() && it->first + params_.bucket_width <= horizon) {
+            rows += it->second.ids.size();
+            it = buckets_.erase(it);
+        }
+        return rows;
+    }
+
+    std::vector<neighbor> search(const float * q, size_t k, const time_window & w = {}, const time_decay & decay = {},
+                                 time_search_stats * stats = nullptr) const {
+        if (k == 0) {
+            return {};
+        }
+        topk_collector     top(k);
+        time_search_stats  local;
+        std::vector<float> dist;
+        // Newest first: with decay, the best candidates come from there.
+        for (auto it = buckets_.rbegin(); it != buckets_.rend(); ++it) {
+            const bucket & b = it->second;
+            if (b.t_max < w.from || b.t_min > w.to) {
+                ++local.buckets_skipped;
+                continue;
+            }
+            // Squared L2 distances are >= 0, so the penalty of the newest
+            // row bounds every score in this and older buckets.
+            if (params_.graph.m == metric::l2 && decay.penalty(std::min(b.t_max, w.to)) >= top.bound()) {
+                local.buckets_pruned += static_cast<size_t>(std::distance(it, buckets_.rend()));
+                break;
+            }
+            search_bucket(b, q, k, w, decay, top, dist);
+            ++local.buckets_searched;
+        }
+        if (stats) {
+            stats->buckets_searched += local.buckets_searched;
+            stats->buckets_skipped += local.buckets_skipped;
+            stats->buckets_pruned += local.buckets_pruned;
+        }
+        return top.results();
+    }
+
+private:
+    // Graph node i of a bucket is ids[i] / ts[i].
+    struct bucket {
+        std::vector<idx_t>           ids;
+        std::vector<int64_t>         ts;
+        std::vector<float>           data; // flat buckets only
+        std::unique_ptr<graph_index> graph;
+        int64_t                      t_min = std::numeric_limits<int64_t>::max();
+        int64_t                      t_max = std::numeric_limits<int64_t>::min();
+    };
+
+    void search_bucket(const bucket & b, const float * q, size_t k, const time_window & w, const time_decay & decay,
+                       topk_collector & top, std::vector<float> & dist) const {
+        auto in_window = [&](size_t i) { return b.ts[i] >= w.from && b.ts[i] <= w.to; };
+        if (b.graph) {
+            const bool            whole = b.t_min >= w.from && b.t_max <= w.to;
+            std::vector<neighbor> res   = whole ? b.graph->search(q, k, params_.ef)
+                                                : b.graph->search_filtered(q, k, params_.ef, in_window);
+            for (const neighbor & r : res) {
+                const size_t i = static_cast<size_t>(r.id);
+                top.push(r.dist + decay.penalty(b.ts[i]), b.ids[i]);
+            }
+            return;
+        }
+        const size_t n = b.ids.size();
+        dist.resize(n);
+        distance_block(params_.graph.m, q, b.data.data(), n, dim_, dist.data());
+        for (size_t i = 0; i < n; ++i) {
+            if (in_window(i)) {
+                top.push(dist[i] + decay.penalty(b.ts[i]), b.ids[i]);
+            }
+        }
+    }
+
+    size_t                    dim_;
+    time_partition_params     params_;
+    std::map<int64_t, bucket> buckets_; // by bucket start
+};
+
+} // namespace e4b
@@ -0,0 +1,285 @@
+// e4b: Embedding database in C/C++
+// Top-k collectors used by flat scans and IVF list scans.
+//
+// simd_topk keeps an unsorted buffer of candidates that beat the current
+// threshold. Distances are tested a block at a time with one vector compare
+// and the survivors are compacted into the buffer; when it fills up a single
+// nth_element shrinks it back to k and tightens the threshold. The threshold
+// is published as soon as k candidates are buffered, so callers pruning on it
+// (bounded list or segment scans) get a finite bound from the first k hits;
+// between compactions it may lag the true k-th distance, but never undercuts
+// it. On typical
+// scans almost every distance is rejected by the compare, so the per-candidate
+// cost is a fraction of a heap push.
+//
+// heap_topk is the classic bounded max-heap, still the better choice for
+// very small k where the buffer would be compacted too often.
+#pragma once
+
+#include "types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace e4b {
+
+class heap_topk {
+public:
+    explicit heap_topk(size_t k) : k_(k) {
+        if (k == 0) {
+            throw std::invalid_argument("heap_topk: k must be > 0");
+        }
+        heap_.reserve(k);
+    }
+
+    size_t k() const { return k_; }
+    size_t size() const { return heap_.size(); }
+
+    float threshold() const {
+        return heap_.size() < k_ ? std::numeric_limits<float>::infinity() : heap_.front().dist;
+    }
+
+    // The threshold is always exact.
+    float bound() { return threshold(); }
+
+    void push(float dist, idx_t id) {
+        if (heap_.size() < k_) {
+            heap_.push_back({dist, id});
+            std::push_heap(heap_.begin(), heap_.end());
+        } else if (dist < heap_.front().dist) {
+            std::pop_heap(heap_.begin(), heap_.end());
+            heap_.back() = {dist, id};
+            std::push_heap(heap_.begin(), heap_.end());
+        }
+    }
+
+    void push_block(const float * dists, const idx_t * ids, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            push(dists[i], ids[i]);
+        }
+    }
+
+    void push_block(const float * dists, idx_t first_id, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            push(dists[i], first_id + static_cast<idx_t>(i));
+        }
+    }
+
+    // Sorted ascending; the collector is left empty.
+    std::vector<neighbor> results() {
+        std::sort_heap(heap_.begin(), heap_.end());
+        std::vector<neighbor> out;
+        out.swap(heap_);
+        return out;
+    }
+
+    void reset() { heap_.clear(); }
+
+private:
+    size_t                k_;
+    std::vector<neighbor> heap_;
+};
+
+class simd_topk {
+public:
+    // Survivors are buffered until buffer_factor * k of them accumulate.
+    explicit simd_topk(size_t k, size_t buffer_factor = 4) : k_(k) {
+        if (k == 0) {
+            throw std::invalid_argument("simd_topk: k must be > 0");
+        }
+        cap_ = std::max<size_t>(k * std::max<size_t>(buffer_factor, 2), k + 64);
+        // Slack so a full SIMD block can always be appended before compaction.
+        buf_.resize(cap_ + lanes);
+    }
+
+    size_t k() const { return k_; }
+
+    // An upper bound on the k-th best distance pushed so far; infinity until
+    // k candidates have been seen.
+    float threshold() const { return threshold_; }
+
+    // The exact k-th best distance so far, compacting the buffer first: what
+    // callers deciding whether a whole list or segment can be skipped read.
+    float bound() {
+        compact();
+        return threshold_;
+    }
+
+    void push(float dist, idx_t id) {
+        if (!(dist < threshold_)) {
+            return;
+        }
+        if (n_ >= cap_) {
+            compact();
+            if (!(dist < threshold_)) {
+                return;
+            }
+        }
+        buf_[n_++] = {dist, id};
+        if (n_ == k_ && !bounded_) {
+            publish();
+        }
+    }
+
+    void push_block(const float * dists, const idx_t * ids, size_t n) {
+        scan(dists, n, [ids](size_t i) { return ids[i]; });
+    }
+
+    void push_block(const float * dists, idx_t first_id, size_t n) {
+        scan(dists, n, [first_id](size_t i) { return first_id + static_cast<idx_t>(i); });
+    }
+
+    // Sorted ascending; the collector is left empty.
+    std::vector<neighbor> results() {
+        const size_t keep = std::min(n_, k_);
+        std::partial_sort(buf_.begin(), buf_.begin() + keep, buf_.begin() + n_);
+        std::vector<neighbor> out(buf_.begin(), buf_.begin() + keep);
+        reset();
+        return out;
+    }
+
+    void reset() {
+        n_         = 0;
+        threshold_ = std::numeric_limits<float>::infinity();
+        bounded_   = false;
+    }
+
+private:
+#if defined(__AVX2__)
+    static constexpr size_t lanes = 8;
+#elif defined(__SSE2__)
+    static constexpr size_t lanes = 4;
+#else
+    static constexpr size_t lanes = 1;
+#endif
+
+    template <typename IdOf>
+    void scan(const float * dists, size_t n, IdOf id_of) {
+        size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+        for (; i + lanes <= n; i += lanes) {
+            if (n_ + lanes > cap_) {
+                compact();
+            }
+#if defined(__AVX2__)
+            const __m256 t    = _mm256_set1_ps(threshold_);
+            const __m256 d    = _mm256_loadu_ps(dists + i);
+            unsigned     mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(d, t, _CMP_LT_OQ)));
+#else
+            const __m128 t    = _mm_set1_ps(threshold_);
+            const __m128 d    = _mm_loadu_ps(dists + i);
+            unsigned     mask = static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(d, t)));
+#endif
+            while (mask) {
+                const size_t j = static_cast<size_t>(__builtin_ctz(mask));
+                buf_[n_++]     = {dists[i + j], id_of(i + j)};
+                mask &= mask - 1;
+            }
+            if (!bounded_ && n_ >= k_) {
+                publish();
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            push(dists[i], id_of(i));
+        }
+    }
+
+    // Shrink the buffer to the k best candidates and raise the bar to the k-th.
+    void compact() {
+        if (n_ <= k_) {
+            return;
+        }
+        std::nth_element(buf_.begin(), buf_.begin() + (k_ - 1), buf_.begin() + n_);
+        threshold_ = buf_[k_ - 1].dist;
+        n_         = k_;
+        bounded_   = true;
+    }
+
+    // First bound, once k candidates are buffered: the k-th distance among them.
+    void publish() {
+        if (n_ > k_) {
+            compact();
+        } else {
+            threshold_ = std::max_element(buf_.begin(), buf_.begin() + n_)->dist;
+            bounded_   = true;
+        }
+    }
+
+    size_t                k_;
+    size_t                cap_;
+    size_t                n_         = 0;
+    float                 threshold_ = std::numeric_limits<float>::infinity();
+    bool                  bounded_   = false; // threshold_ published
+    std::vector<neighbor> buf_;
+};
+
+enum class topk_strategy {
+    automatic, // heap for k <= heap_max_k, simd otherwise
+    heap,
+    simd,
+};
+
+// Collector used by the scan loops. The strategy is fixed at construction and
+// dispatched once per block, so the inner loops stay branch-free.
+class topk_collector {
+public:
+    static constexpr size_t heap_max_k = 8;
+
+    explicit topk_collector(size_t k, topk_strategy strategy = topk_strategy::automatic)
+        : use_heap_(strategy == topk_strategy::heap || (strategy == topk_strategy::automatic && k <= heap_max_k)),
+          heap_(k),
+          simd_(use_heap_ ? 1 : k) {}
+
+    size_t k() const { return heap_.k(); }
+
+    float threshold() const { return use_heap_ ? heap_.threshold() : simd_.threshold(); }
+    float bound() { return use_heap_ ? heap_.bound() : simd_.bound(); }
+
+    void push(float dist, idx_t id) {
+        if (use_heap_) {
+            heap_.push(dist, id);
+        } else {
+            simd_.push(dist, id);
+        }
+    }
+
+    void push_block(const float * dists, const idx_t * ids, size_t n) {
+        if (use_heap_) {
+            heap_.push_block(dists, ids, n);
+        } else {
+            simd_.push_block(dists, ids, n);
+        }
+    }
+
+    void push_block(const float * dists, idx_t first_id, size_t n) {
+        if (use_heap_) {
+            heap_.push_block(dists, first_id, n);
+        } else {
+            simd_.push_block(dists, first_id, n);
+        }
+    }
+
+    std::vector<neighbor> results() { return use_heap_ ? heap_.results() : simd_.results(); }
+
+    void reset() {
+        heap_.reset();
+        simd_.reset();
+    }
+
+private:
+    bool      use_heap_;
+    heap_topk heap_;
+    simd_topk simd_;
+};
+
+} // namespace e4b
@@ -0,0 +1,30 @@
+// e4b: Embedding database in C/C++
+// Core scalar types shared by every index.
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace e4b {
+
+// Row number of a vector inside a segment or index.
+using idx_t = int64_t;
+
+constexpr idx_t invalid_idx = -1;
+
+// One search hit: smaller dist is better for every metric e4b exposes
+// (inner product is negated by the caller before it reaches a collector).
+struct neighbor {
+    float dist = std::numeric_limits<float>::infinity();
+    idx_t id   = invalid_idx;
+};
+
+inline bool operator<(const neighbor & a, const neighbor & b) {
+    return a.dist < b.dist || (a.dist == b.dist && a.id < b.id);
+}
+
+inline bool operator==(const neighbor & a, const neighbor & b) {
+    return a.dist == b.dist && a.id == b.id;
+}
+
+} // namespace e4b
@@ -0,0 +1,172 @@
+// e4b: Embedding database in C/C++
+// Upserts with versioned records over a mutable graph index.
+//
+// Every write carries a sequence number. An upsert inserts the new vector as
+// a fresh graph node, points the id map at it and tombstones the node of the
+// previous version; a delete only tombstones. For each id, the write with the
+// highest sequence number wins whatever order writes are applied in, so
+// concurrent writers racing on one id converge deterministically. A write
+// whose sequence number is not newer than the current one is dropped.
+//
+// Tombstoned nodes stay in the graph, where they still route searches (the
+// filtered search expands them like live ones, see filtered_beam_search), but
+// never enter results: at most one node per id is live, so a query can never
+// return two versions of the same id. dead_fraction() tells when compaction
+// (rebuilding from live nodes) is worth it.
+//
+// Results carry external ids as idx_t (the uint64_t bit pattern); the id
+// whose pattern is invalid_idx, UINT64_MAX, is rejected by every write.
+//
+// Writers serialise on an exclusive lock, queries share it.
+#pragma once
+
+#include "graph_index.h"
+#include "id_map.h"
+#include "types.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace e4b {
+
+class upsert_index {
+public:
+    upsert_index(size_t dim, graph_params p = {}) : graph_(dim, p) {}
+
+    // Sequence numbers for callers that do not bring their own (e.g. from a
+    // WAL); strictly increasing across threads and above every seq applied.
+    uint64_t next_seq() { return seq_.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    // Writes version `seq` of `id`; returns false if a version at least as
+    // new is already recorded (including a delete).
+    bool upsert(uint64_t id, const float * x, uint64_t seq) {
+        check_id(id);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        observe(seq);
+        record & r = slot(id);
+        if (r.written && seq <= r.seq) {
+            return false;
+        }
+        const uint32_t node = static_cast<uint32_t>(graph_.size());
+        graph_.add(x, 1);
+        node_id_.push_back(id);
+        live_.push_back(1);
+        retire(r);
+        r.node    = node;
+        r.seq     = seq;
+        r.written = true;
+        ++live_count_;
+        return true;
+    }
+
+    // Records deletion of `id` at `seq`; an older upsert arriving later is
+    // then dropped. Returns false if a newer version is already recorded.
+    bool remove(uint64_t id, uint64_t seq) {
+        check_id(id);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        observe(seq);
+        record & r = slot(id);
+        if (r.written && seq <= r.seq) {
+            return false;
+        }
+        retire(r);
+        r.node    = invalid_node;
+        r.seq     = seq;
+        r.written = true;
+        return true;
+    }
+
+    bool contains(uint64_t id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const uint32_t                      s = ids_.find(id);
+        return s != id_map_absent && records_[s].node != invalid_node;
+    }
+
+    // Sequence number of the latest write of `id`, or 0 if none.
+    uint64_t version(uint64_t id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const uint32_t                      s = ids_.find(id);
+        return s == id_map_absent ? 0 : records_[s].seq;
+    }
+
+    // k nearest live records, with external ids.
+    std::vector<neighbor> search(const float * q, size_t k, size_t ef, search_stats * stats = nullptr) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        std::vector<neighbor>               res;
+        if (live_count_ == graph_.size()) {
+            res = graph_.search(q, k, ef, stats);
+        } else {
+            res = graph_.search_filtered(q, k, ef, [this](uint32_t v) { return live_[v] != 0; }, stats);
+        }
+        for (neighbor & r : res) {
+            r.id = static_cast<idx_t>(node_id_[static_cast<size_t>(r.id)]);
+        }
+        return res;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return live_count_;
+    }
+
+    size_t nodes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return graph_.size();
+    }
+
+    double dead_fraction() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return graph_.size() == 0 ? 0.0
+                                  : static_cast<double>(graph_.size() - live_count_) / static_cast<double>(graph_.size());
+    }
+
+private:
+    struct record {
+        uint32_t node    = invalid_node; // live node, invalid_node once deleted
+        uint64_t seq     = 0;
+        bool     written = false;
+    };
+
+    static void check_id(uint64_t id) {
+        if (id == static_cast<uint64_t>(invalid_idx)) {
+            throw std::invalid_argument("upsert_index: id UINT64_MAX is reserved");
+        }
+    }
+
+    record & slot(uint64_t id) {
+        const auto s = ids_.assign(id);
+        if (s.second) {
+            records_.emplace_back();
+        }
+        return records_[s.first];
+    }
+
+    void observe(uint64_t seq) {
+        uint64_t cur = seq_.load(std::memory_order_relaxed);
+        while (cur < seq && !seq_.compare_exchange_weak(cur, seq, std::memory_order_relaxed)) {
+        }
+    }
+
+    void retire(const record & r) {
+        if (r.node != invalid_node) {
+            live_[r.node] = 0;
+            --live_count_;
+        }
+    }
+
+    graph_index               graph_;
+    id_map                    ids_; // external id -> records_ slot
+    std::vector<record>       records_;
+    std::vector<uint64_t>     node_id_; // external id of every node
+    std::vector<uint8_t>      live_;    // 0 once tombstoned
+    size_t                    live_count_ = 0;
+    std::atomic<uint64_t>     seq_{ 0 };
+    mutable std::shared_mutex mutex_;
+};
+
+} // namespace e4b
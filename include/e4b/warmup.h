@@ -0,0 +1,382 @@
+// e4b: Embedding database in C/C++
+// Lazy collection opening and startup warm-up from recorded access profiles.
+//
+// A node hosting thousands of collections wraps each of them in a
+// lazy_collection so nothing is loaded until the first query. While serving,
+// the hot file regions (pages of vectors, segments, graph entry regions) are
+// recorded into an access_profile which is saved on shutdown; on the next
+// start prefetch() replays it with parallel readahead so the page cache is
+// warm before traffic arrives.
+#pragma once
+
+#include "atomic_shared_ptr.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+// Opens T on first access. Thread-safe; a failed load is retried on the next get().
+template <typename T>
+class lazy_collection {
+public:
+    using loader = std::function<std::shared_ptr<T>()>;
+
+    explicit lazy_collection(loader load) : load_(std::move(load)) {}
+
+    std::shared_ptr<T> get() {
+        std::shared_ptr<T> p = value_.load(std::memory_order_acquire);
+        if (p) {
+            return p;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        p = value_.load(std::memory_order_relaxed);
+        if (!p) {
+            p = load_();
+            value_.store(p, std::memory_order_release);
+        }
+        return p;
+    }
+
+    bool loaded() const { return value_.load(std::memory_order_acquire) != nullptr; }
+
+    // Drops this handle's reference; in-flight users keep theirs until done.
+    void unload() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        value_.store(std::shared_ptr<T>(), std::memory_order_release);
+    }
+
+private:
+    loader               load_;
+    std::mutex           mutex_;
+    atomic_shared_ptr<T> value_;
+};
+
+// Name -> lazily opened collection. Registration is cheap; opening happens on lookup.
+template <typename T>
+class lazy_registry {
+public:
+    using opener = std::function<std::shared_ptr<T>(const std::string & name)>;
+
+    explicit lazy_registry(opener open) : open_(std::move(open)) {}
+
+    void add(const std::string & name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entries_.count(name) == 0) {
+            entries_.emplace(name, std::make_unique<lazy_collection<T>>([this, name] { return open_(name); }));
+        }
+    }
+
+    // Throws std::out_of_range for unknown names.
+    std::shared_ptr<T> get(const std::string & name) {
+        lazy_collection<T> * c = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = entries_.find(name);
+            if (it == entries_.end()) {
+                throw std::out_of_range("lazy_registry: unknown collection " + name);
+            }
+            c = it->second.get();
+        }
+        return c->get();
+    }
+
+    size_t loaded_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t                      n = 0;
+        for (const auto & e : entries_) {
+            n += e.second->loaded() ? 1 : 0;
+        }
+        return n;
+    }
+
+    // Waits for an in-flight load of `name`, but not while holding the
+    // registry lock: lookups of other collections (and the opener itself)
+    // proceed meanwhile. Entries are never erased, so `c` stays valid.
+    void unload(const std::string & name) {
+        lazy_collection<T> * c = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = entries_.find(name);
+            if (it == entries_.end()) {
+                return;
+            }
+            c = it->second.get();
+        }
+        c->unload();
+    }
+
+private:
+    opener                                                           open_;
+    mutable std::mutex                                               mutex_;
+    std::map<std::string, std::unique_ptr<lazy_collection<T>>>       entries_;
+};
+
+struct profile_region {
+    std::string path;
+    uint64_t    offset = 0;
+    uint64_t    length = 0;
+    uint64_t    hits   = 0;
+};
+
+// Page-granular record of which file regions were hot while serving.
+class access_profile {
+public:
+    static constexpr uint64_t page_size = 64 * 1024;
+
+    void record(const std::string & path, uint64_t offset, uint64_t length, uint64_t hits = 1) {
+        if (length == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &                      pages = files_[path];
+        for (uint64_t p = offset / page_size; p <= (offset + length - 1) / page_size; ++p) {
+            pages[p] += hits;
+        }
+    }
+
+    // Hottest pages first, adjacent pages of a file merged, capped at max_bytes.
+    std::vector<profile_region> regions(uint64_t max_bytes = UINT64_MAX) const {
+        struct page {
+            const std::string * path;
+            uint64_t            index;
+            uint64_t            hits;
+        };
+        std::vector<page> pages;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto & f : files_) {
+                for (const auto & p : f.second) {
+                    pages.push_back({&f.first, p.first, p.second});
+                }
+            }
+            std::sort(pages.begin(), pages.end(), [](const page & a, const page & b) { return a.hits > b.hits; });
+            if (pages.size() > max_bytes / page_size) {
+                pages.resize(max_bytes / page_size);
+            }
+            std::sort(pages.begin(), pages.end(), [](const page & a, const page & b) {
+                return *a.path < *b.path || (*a.path == *b.path && a.index < b.index);
+            });
+        }
+        std::vector<profile_region> out;
+        for (const page & p : pages) {
+            if (!out.empty() && out.back().path == *p.path && out.back().offset + out.back().length == p.index * page_size) {
+                out.back().length += page_size;
+                out.back().hits += p.hits;
+                continue;
+            }
+            out.push_back({*p.path, p.index * page_size, page_size, p.hits});
+        }
+        std::stable_sort(out.begin(), out.end(), [](const profile_region & a, const profile_region & b) {
+            return a.hits * b.length > b.hits * a.length;
+        });
+        return out;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        files_.clear();
+    }
+
+private:
+    mutable std::mutex                                                       mutex_;
+    std::unordered_map<std::string, std::unordered_map<uint64_t, uint64_t>> files_;
+};
+
+namespace detail {
+
+constexpr char profile_magic[8] = {'E', '4', 'B', 'W', 'A', 'R', 'M', '1'};
+
+inline void write_u64(std::FILE * f, uint64_t v) {
+    if (std::fwrite(&v, sizeof(v), 1, f) != 1) {
+        throw std::system_error(errno, std::generic_category(), "warmup: write");
+    }
+}
+
+// Bytes between the read position and the end of the file.
+inline uint64_t remaining(std::FILE * f) {
+    const long pos = std::ftell(f);
+    if (pos < 0 || std::fseek(f, 0, SEEK_END) != 0) {
+        throw std::system_error(errno, std::generic_category(), "warmup: seek");
+    }
+    const long end = std::ftell(f);
+    if (end < 0 || std::fseek(f, pos, SEEK_SET) != 0) {
+        throw std::system_error(errno, std::generic_category(), "warmup: seek");
+    }
+    return static_cast<uint64_t>(end - pos);
+}
+
+inline uint64_t read_u64(std::FILE * f) {
+    uint64_t v = 0;
+    if (std::fread(&v, sizeof(v), 1, f) != 1) {
+        throw std::runtime_error("warmup: truncated profile");
+    }
+    return v;
+}
+
+} // namespace detail
+
+// Written to a temporary and renamed, so a crash never leaves a torn profile.
+inline void save_profile(const std::string & path, const std::vector<profile_region> & regions) {
+    const std::string tmp = path + ".tmp";
+    std::FILE *       f   = std::fopen(tmp.c_str(), "wb");
+    if (!f) {
+        throw std::system_error(errno, std::generic_category(), "warmup: open " + tmp);
+    }
+    try {
+        if (std::fwrite(detail::profile_magic, sizeof(detail::profile_magic), 1, f) != 1) {
+            throw std::system_error(errno, std::generic_category(), "warmup: write");
+        }
+        detail::write_u64(f, regions.size());
+        for (const profile_region & r : regions) {
+            detail::write_u64(f, r.path.size());
+            if (!r.path.empty() && std::fwrite(r.path.data(), r.path.size(), 1, f) != 1) {
+                throw std::system_error(errno, std::generic_category(), "warmup: write");
+            }
+            detail::write_u64(f, r.offset);
+            detail::write_u64(f, r.length);
+            detail::write_u64(f, r.hits);
+        }
+        // The contents must be durable before the rename makes them visible.
+        if (std::fflush(f) != 0 || ::fsync(::fileno(f)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "warmup: fsync " + tmp);
+        }
+    } catch (...) {
+        std::fclose(f);
+        std::remove(tmp.c_str());
+        throw;
+    }
+    if (std::fclose(f) != 0 || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::system_error(errno, std::generic_category(), "warmup: save " + path);
+    }
+    // Persist the rename itself.
+    const size_t      slash = path.rfind('/');
+    const std::string dir   = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int         dfd   = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+// A missing profile is not an error: it just means a cold start.
+inline std::vector<profile_region> load_profile(const std::string & path) {
+    std::vector<profile_region> out;
+    std::FILE *                 f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        return out;
+    }
+    try {
+        char magic[sizeof(detail::profile_magic)];
+        if (std::fread(magic, sizeof(magic), 1, f) != 1 ||
+            std::memcmp(magic, detail::profile_magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("warmup: bad profile magic in " + path);
+        }
+        // Length fields are checked against what is left of the file before
+        // anything is allocated, so a corrupt profile cannot ask for more.
+        const uint64_t n      = detail::read_u64(f);
+        uint64_t       bytes  = detail::remaining(f);
+        const uint64_t record = 4 * sizeof(uint64_t); // path length, offset, length, hits
+        if (n > bytes / record) {
+            throw std::runtime_error("warmup: corrupt profile " + path);
+        }
+        out.reserve(n);
+        for (uint64_t i = 0; i < n; ++i) {
+            profile_region r;
+            const uint64_t len = detail::read_u64(f);
+            if (bytes < record || len > bytes - record) {
+                throw std::runtime_error("warmup: corrupt profile " + path);
+            }
+            bytes -= record + len;
+            r.path.resize(len);
+            if (!r.path.empty() && std::fread(&r.path[0], r.path.size(), 1, f) != 1) {
+                throw std::runtime_error("warmup: truncated profile");
+            }
+            r.offset = detail::read_u64(f);
+            r.length = detail::read_u64(f);
+            r.hits   = detail::read_u64(f);
+            out.push_back(std::move(r));
+        }
+    } catch (...) {
+        std::fclose(f);
+        throw;
+    }
+    std::fclose(f);
+    return out;
+}
+
+struct prefetch_stats {
+    uint64_t regions = 0;
+    uint64_t bytes   = 0;
+    uint64_t errors  = 0; // missing files etc.; warm-up is best effort
+};
+
+// Issue readahead for every region using n_threads workers. Regions are
+// consumed in profile order, so the hottest data lands first.
+inline prefetch_stats prefetch(const std::vector<profile_region> & regions, size_t n_threads = 4) {
+    std::atomic<size_t>   next{0};
+    std::atomic<uint64_t> done{0}, bytes{0}, errors{0};
+
+    auto worker = [&] {
+        std::unordered_map<std::string, int> fds;
+        for (size_t i = next++; i < regions.size(); i = next++) {
+            const profile_region & r  = regions[i];
+            auto                   it = fds.find(r.path);
+            if (it == fds.end()) {
+                it = fds.emplace(r.path, ::open(r.path.c_str(), O_RDONLY)).first;
+            }
+            if (it->second < 0) {
+                ++errors;
+                continue;
+            }
+#if defined(__linux__)
+            const bool ok = ::readahead(it->second, static_cast<off_t>(r.offset), r.length) == 0;
+#else
+            const bool ok = ::posix_fadvise(it->second, static_cast<off_t>(r.offset), static_cast<off_t>(r.length),
+                                            POSIX_FADV_WILLNEED) == 0;
+#endif
+            if (ok) {
+                ++done;
+                bytes += r.length;
+            } else {
+                ++errors;
+            }
+        }
+        for (const auto & f : fds) {
+            if (f.second >= 0) {
+                ::close(f.second);
+            }
+        }
+    };
+
+    n_threads = std::max<size_t>(1, std::min(n_threads, regions.size()));
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < n_threads; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread & t : threads) {
+        t.join();
+    }
+    return {done.load(), bytes.load(), errors.load()};
+}
+
+} // namespace e4b
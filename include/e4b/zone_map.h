@@ -0,0 +1,175 @@
+// e4b: Embedding database in C/C++
+// Segment-level zone maps and the planner that prunes segments with them.
+//
+// A zone_map summarises one sealed segment: row count, timestamp range,
+// min/max of every numeric attribute, and the centroid plus radius (largest
+// euclidean distance to a member) of its vectors. search_segments() skips a
+// segment when its zone map proves the filter cannot match any row, and,
+// visiting the remaining segments closest-bound first, when the triangle
+// inequality proves none of its vectors can beat the current k-th distance.
+// The distance bound assumes metric::l2.
+#pragma once
+
+#include "distance.h"
+#include "topk.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace e4b {
+
+struct attr_range {
+    size_t column = 0;
+    double lo     = -std::numeric_limits<double>::infinity();
+    double hi     = std::numeric_limits<double>::infinity();
+};
+
+// Conjunction of a timestamp window and attribute ranges, all inclusive.
+struct zone_filter {
+    int64_t                 t_min = std::numeric_limits<int64_t>::min();
+    int64_t                 t_max = std::numeric_limits<int64_t>::max();
+    std::vector<attr_range> ranges;
+};
+
+class zone_map {
+public:
+    zone_map() = default;
+
+    // x: n vectors of dim floats. timestamps: n values, or null. attrs: n rows
+    // of n_attrs values, or null.
+    static zone_map build(const float * x, size_t n, size_t dim, const int64_t * timestamps = nullptr,
+                          const double * attrs = nullptr, size_t n_attrs = 0) {
+        zone_map z;
+        z.count_ = n;
+        z.centroid_.assign(dim, 0.0f);
+        if (n == 0) {
+            return z;
+        }
+        std::vector<double> sum(dim, 0.0);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < dim; ++j) {
+                sum[j] += x[i * dim + j];
+            }
+        }
+        for (size_t j = 0; j < dim; ++j) {
+            z.centroid_[j] = static_cast<float>(sum[j] / static_cast<double>(n));
+        }
+        float r2 = 0;
+        for (size_t i = 0; i < n; ++i) {
+            r2 = std::max(r2, l2_sqr(x + i * dim, z.centroid_.data(), dim));
+        }
+        z.radius_ = std::sqrt(r2);
+
+        if (timestamps) {
+            const auto mm = std::minmax_element(timestamps, timestamps + n);
+            z.t_min_      = *mm.first;
+            z.t_max_      = *mm.second;
+        }
+        z.min_.assign(n_attrs, std::numeric_limits<double>::infinity());
+        z.max_.assign(n_attrs, -std::numeric_limits<double>::infinity());
+        for (size_t i = 0; i < n && attrs; ++i) {
+            for (size_t c = 0; c < n_attrs; ++c) {
+                z.min_[c] = std::min(z.min_[c], attrs[i * n_attrs + c]);
+                z.max_[c] = std::max(z.max_[c], attrs[i * n_attrs + c]);
+            }
+        }
+        return z;
+    }
+
+    size_t                     count() const { return count_; }
+    int64_t                    t_min() const { return t_min_; }
+    int64_t                    t_max() const { return t_max_; }
+    double                     min(size_t column) const { return min_[column]; }
+    double                     max(size_t column) const { return max_[column]; }
+    size_t                     attr_count() const { return min_.size(); }
+    const std::vector<float> & centroid() const { return centroid_; }
+    float                      radius() const { return radius_; }
+
+    // False only when no row of the segment can satisfy f. Filters on
+    // columns the zone map does not track never prune.
+    bool may_match(const zone_filter & f) const {
+        if (count_ == 0 || t_max_ < f.t_min || t_min_ > f.t_max) {
+            return false;
+        }
+        for (const attr_range & r : f.ranges) {
+            if (r.column < min_.size() && (max_[r.column] < r.lo || min_[r.column] > r.hi)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Smallest possible squared L2 distance from q to a vector of the segment.
+    float lower_bound(const float * q) const {
+        const float gap = std::sqrt(l2_sqr(q, centroid_.data(), centroid_.size())) - radius_;
+        return gap > 0 ? gap * gap : 0.0f;
+    }
+
+private:
+    size_t              count_ = 0;
+    // Without timestamps the segment spans all time.
+    int64_t             t_min_ = std::numeric_limits<int64_t>::min();
+    int64_t             t_max_ = std::numeric_limits<int64_t>::max();
+    std::vector<double> min_, max_;
+    std::vector<float>  centroid_;
+    float               radius_ = 0;
+};
+
+struct zone_stats {
+    size_t segments        = 0; // segments considered
+    size_t pruned_filter   = 0; // skipped: the filter cannot match
+    size_t pruned_distance = 0; // skipped: cannot beat the k-th distance
+    size_t searched        = 0;
+};
+
+// Searches segments zones[0..n) for the k nearest rows matching f.
+// `search(i, k)` runs the filtered search of segment i and returns its
+// results with global ids; it is only called for segments that survive
+// pruning, closest lower bound first.
+template <typename SearchFn>
+std::vector<neighbor> search_segments(const zone_map * zones, size_t n, const float * q, size_t k,
+                                      const zone_filter & f, SearchFn && search, zone_stats * stats = nullptr) {
+    if (k == 0) {
+        return {};
+    }
+    zone_stats                            local;
+    std::vector<std::pair<float, size_t>> order;
+    local.segments = n;
+    for (size_t i = 0; i < n; ++i) {
+        if (!zones[i].may_match(f)) {
+            ++local.pruned_filter;
+            continue;
+        }
+        order.emplace_back(zones[i].lower_bound(q), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    topk_collector top(k);
+    for (size_t o = 0; o < order.size(); ++o) {
+        if (order[o].first >= top.bound()) {
+            // Bounds are sorted: every remaining segment is out of reach.
+            local.pruned_distance += order.size() - o;
+            break;
+        }
+        for (const neighbor & r : search(order[o].second, k)) {
+            top.push(r.dist, r.id);
+        }
+        ++local.searched;
+    }
+
+    if (stats) {
+        stats->segments += local.segments;
+        stats->pruned_filter += local.pruned_filter;
+        stats->pruned_distance += local.pruned_distance;
+        stats->searched += local.searched;
+    }
+    return top.results();
+}
+
+} // namespace e4b